@@ -4,7 +4,12 @@
 
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
 
 /* A block device. */
 struct block {
@@ -17,10 +22,35 @@ struct block {
     const struct block_operations *ops;       /* Driver operations. */
     void                          *aux;       /* Extra data owned by driver. */
 
-    unsigned long long             read_cnt;  /* Number of sectors read. */
-    unsigned long long             write_cnt; /* Number of sectors written. */
+    /* Statistics.  Updated under the queue lock of the device
+     * that owns the queue. */
+    struct block_stats             stats;     /* Statistics. */
+    block_sector_t                 next_sector[2]; /* Where the last read
+                                               * and write ended. */
+
+    /* If this is a partition, its requests go to WHOLE's queue. */
+    struct block                  *whole;     /* Containing device, or null. */
+    block_sector_t                 start;     /* First sector within WHOLE. */
+
+    /* Request queue, used only if WHOLE is null. */
+    struct lock                    queue_lock;   /* Protects the members below. */
+    struct condition               queue_ready;  /* Signaled on submit. */
+    struct rbtree                  queue[BLOCK_IO_CLASS_CNT]; /* Requests ordered
+                                                 * by sector, per class. */
+    unsigned                       passed_over[BLOCK_IO_CLASS_CNT]; /* Turns
+                                                 * each class has waited. */
+    block_sector_t                 queue_head;   /* Where the last request ended. */
+    bool                           queue_thread; /* I/O thread started? */
 };
 
+/* Most sectors that the I/O thread merges into one driver call. */
+#define MERGE_MAX 256
+
+/* A class that has been passed over this many times in a row,
+ * while it had requests waiting, is served next regardless of
+ * priority. */
+#define STARVE_LIMIT 8
+
 /* List of all block devices. */
 static struct list all_blocks = LIST_INITIALIZER(all_blocks);
 
@@ -28,6 +58,12 @@ static struct list all_blocks = LIST_INITIALIZER(all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block(struct list_elem *);
+static rb_less_func request_less;
+static struct block *queue_owner(struct block *);
+static int depth_bucket(struct block *);
+static int latency_bucket(uint64_t);
+static void print_device_stats(struct block *);
+static thread_func io_thread;
 
 /* Returns a human-readable name for the given block device
  * TYPE. */
@@ -112,6 +148,19 @@ check_sector(struct block *block, block_sector_t sector)
     }
 }
 
+/* Verifies that the CNT sectors starting at SECTOR are all
+ * within BLOCK.  Panics if not. */
+static void
+check_sectors(struct block *block, block_sector_t sector, size_t cnt)
+{
+    check_sector(block, sector);
+    if (cnt > block->size - sector) {
+        PANIC("Access past end of device %s (sector=%"PRDSNu ", cnt=%zu, "
+              "size=%"PRDSNu ")\n", block_name(block), sector, cnt,
+              block->size);
+    }
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
  * have room for BLOCK_SECTOR_SIZE bytes.
  * Internally synchronizes accesses to block devices, so external
@@ -119,9 +168,7 @@ check_sector(struct block *block, block_sector_t sector)
 void
 block_read(struct block *block, block_sector_t sector, void *buffer)
 {
-    check_sector(block, sector);
-    block->ops->read(block->aux, sector, buffer);
-    block->read_cnt++;
+    block_read_multiple(block, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -132,10 +179,380 @@ block_read(struct block *block, block_sector_t sector, void *buffer)
 void
 block_write(struct block *block, block_sector_t sector, const void *buffer)
 {
-    check_sector(block, sector);
-    ASSERT(block->type != BLOCK_FOREIGN);
-    block->ops->write(block->aux, sector, buffer);
-    block->write_cnt++;
+    block_write_multiple(block, sector, 1, buffer);
+}
+
+/* Completion callback for synchronous requests: wakes the thread
+ * waiting on semaphore SEMA_. */
+static void
+wake_waiter(struct block_request *r UNUSED, void *sema_)
+{
+    struct semaphore *sema = sema_;
+
+    sema_up(sema);
+}
+
+/* Reads (or, if WRITE, writes) the CNT consecutive sectors
+ * starting at SECTOR of BLOCK into (or from) BUFFER, as a request
+ * of class IO_CLASS, and waits for the transfer to complete. */
+void
+block_transfer(struct block *block, enum block_io_class io_class,
+               bool write, block_sector_t sector, size_t cnt, void *buffer)
+{
+    struct block_request r;
+    struct semaphore done;
+
+    if (cnt == 0) {
+        return;
+    }
+    sema_init(&done, 0);
+    block_request_init(&r, write, sector, cnt, buffer, wake_waiter, &done);
+    block_request_set_class(&r, io_class);
+    block_submit(block, &r);
+    sema_down(&done);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from
+ * BLOCK into BUFFER, which must have room for CNT *
+ * BLOCK_SECTOR_SIZE bytes.  Drivers that can do so transfer them
+ * with a single command; others get one read per sector.
+ * Internally synchronizes accesses to block devices, so external
+ * per-block device locking is unneeded. */
+void
+block_read_multiple(struct block *block, block_sector_t sector, size_t cnt,
+                    void *buffer)
+{
+    block_transfer(block, BLOCK_IO_NORMAL, false, sector, cnt, buffer);
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR to BLOCK
+ * from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+ * Returns after the block device has acknowledged receiving all
+ * of the data.  Drivers that can do so transfer them with a
+ * single command; others get one write per sector.
+ * Internally synchronizes accesses to block devices, so external
+ * per-block device locking is unneeded. */
+void
+block_write_multiple(struct block *block, block_sector_t sector, size_t cnt,
+                     const void *buffer)
+{
+    block_transfer(block, BLOCK_IO_NORMAL, true, sector, cnt,
+                   (void *)buffer);
+}
+
+/* Initializes R as a request to read (or, if WRITE, to write)
+ * the CNT sectors starting at SECTOR into (or from) BUFFER, and
+ * to call DONE with auxiliary data AUX when it completes. */
+void
+block_request_init(struct block_request *r, bool write,
+                   block_sector_t sector, size_t cnt, void *buffer,
+                   block_done_func *done, void *aux)
+{
+    ASSERT(cnt > 0);
+    ASSERT(done != NULL);
+
+    r->write = write;
+    r->sector = sector;
+    r->cnt = cnt;
+    r->buffer = buffer;
+    r->done = done;
+    r->aux = aux;
+    r->io_class = BLOCK_IO_NORMAL;
+    r->merged = NULL;
+}
+
+/* Sets the I/O class of R, which must not have been submitted. */
+void
+block_request_set_class(struct block_request *r, enum block_io_class io_class)
+{
+    ASSERT(io_class < BLOCK_IO_CLASS_CNT);
+
+    r->io_class = io_class;
+}
+
+/* Queues request R on BLOCK and returns without waiting for it.
+ * R's callback runs in BLOCK's I/O thread once the transfer is
+ * done.  Must not be called from an interrupt handler. */
+void
+block_submit(struct block *block, struct block_request *r)
+{
+    struct block_op_stats *op;
+    struct block_class_stats *stats;
+    struct block *owner;
+
+    ASSERT(!intr_context());
+
+    check_sectors(block, r->sector, r->cnt);
+    ASSERT(!r->write || block->type != BLOCK_FOREIGN);
+
+    /* The I/O thread that does the transfer has no user
+     * mappings. */
+    ASSERT(is_kernel_vaddr(r->buffer));
+
+    owner = queue_owner(block);
+    lock_acquire(&owner->queue_lock);
+
+    /* Account for the request on the device it was submitted to. */
+    r->origin = block;
+    op = r->write ? &block->stats.write : &block->stats.read;
+    op->requests++;
+    op->sectors += r->cnt;
+    if (r->sector == block->next_sector[r->write]) {
+        op->sequential++;
+    }
+    block->next_sector[r->write] = r->sector + r->cnt;
+
+    /* Redirect requests to a partition. */
+    for (; block->whole != NULL; block = block->whole) {
+        r->sector += block->start;
+    }
+
+    if (!block->queue_thread) {
+        block->queue_thread = true;
+        thread_create(block->name, PRI_DEFAULT, io_thread, block);
+    }
+    r->submitted = rdtsc();
+    rb_insert_multi(&block->queue[r->io_class], &r->elem);
+    block->stats.depth_histogram[depth_bucket(block)]++;
+    stats = &block->stats.classes[r->io_class];
+    if (++stats->depth > stats->max_depth) {
+        stats->max_depth = stats->depth;
+    }
+    cond_signal(&block->queue_ready, &block->queue_lock);
+    lock_release(&block->queue_lock);
+}
+
+/* Returns the device whose queue serves requests to BLOCK. */
+static struct block *
+queue_owner(struct block *block)
+{
+    while (block->whole != NULL) {
+        block = block->whole;
+    }
+    return block;
+}
+
+/* Returns the depth histogram bucket for the number of requests
+ * already in BLOCK's queue. */
+static int
+depth_bucket(struct block *block)
+{
+    unsigned depth = 0;
+    int bucket;
+    int c;
+
+    for (c = 0; c < BLOCK_IO_CLASS_CNT; c++) {
+        depth += block->stats.classes[c].depth;
+    }
+    for (bucket = 0; depth > 0 && bucket < BLOCK_DEPTH_BUCKETS - 1;
+         bucket++) {
+        depth >>= 1;
+    }
+    return bucket;
+}
+
+/* Returns the latency histogram bucket for LATENCY cycles. */
+static int
+latency_bucket(uint64_t latency)
+{
+    int bucket;
+
+    for (bucket = 0; latency > 1 && bucket < BLOCK_LATENCY_BUCKETS - 1;
+         bucket++) {
+        latency >>= 1;
+    }
+    return bucket;
+}
+
+/* Orders requests by starting sector. */
+static bool
+request_less(const struct rb_elem *a_, const struct rb_elem *b_,
+             void *aux UNUSED)
+{
+    const struct block_request *a = rb_entry(a_, struct block_request, elem);
+    const struct block_request *b = rb_entry(b_, struct block_request, elem);
+
+    return a->sector < b->sector;
+}
+
+/* Returns the class whose turn it is in BLOCK's queue, which
+ * must not be empty: the highest-priority class with requests
+ * waiting, unless a lower one has been passed over STARVE_LIMIT
+ * times. */
+static enum block_io_class
+pick_class(struct block *block)
+{
+    int best = -1;
+    int c;
+
+    for (c = BLOCK_IO_CLASS_CNT - 1; c >= 0; c--) {
+        if (!rb_empty(&block->queue[c])
+            && (best < 0 || block->passed_over[best] < STARVE_LIMIT)) {
+            best = c;
+        }
+    }
+    ASSERT(best >= 0);
+
+    for (c = 0; c < BLOCK_IO_CLASS_CNT; c++) {
+        if (c == best || rb_empty(&block->queue[c])) {
+            block->passed_over[c] = 0;
+        } else {
+            block->passed_over[c]++;
+        }
+    }
+    return best;
+}
+
+/* Removes the next request from BLOCK's queue, which must not be
+ * empty, together with the following requests that it can be
+ * merged with.  The request comes from the class chosen by
+ * pick_class(), in C-LOOK order within the class.  Chains the
+ * requests through their `merged' members and returns the total
+ * number of sectors in *CNT. */
+static struct block_request *
+dequeue(struct block *block, size_t *cnt)
+{
+    struct rbtree *queue = &block->queue[pick_class(block)];
+    struct block_request key = { .sector = block->queue_head };
+    struct block_request *first, *last;
+    struct rb_elem *e;
+
+    e = rb_lower_bound(queue, &key.elem);
+    if (e == NULL) {
+        e = rb_first(queue);
+    }
+    first = last = rb_entry(e, struct block_request, elem);
+    *cnt = first->cnt;
+
+    for (;;) {
+        struct rb_elem *next_e = rb_next(e);
+        struct block_request *next;
+
+        rb_remove(queue, e);
+        if (next_e == NULL) {
+            break;
+        }
+        next = rb_entry(next_e, struct block_request, elem);
+        if (next->write != first->write
+            || next->sector != last->sector + last->cnt
+            || (uint8_t *)next->buffer
+               != (uint8_t *)last->buffer + last->cnt * BLOCK_SECTOR_SIZE
+            || *cnt + next->cnt > MERGE_MAX) {
+            break;
+        }
+        last->merged = next;
+        last = next;
+        *cnt += next->cnt;
+        e = next_e;
+    }
+
+    block->queue_head = first->sector + *cnt;
+    return first;
+}
+
+/* Returns true if BLOCK's queue holds no requests. */
+static bool
+queue_empty(struct block *block)
+{
+    int c;
+
+    for (c = 0; c < BLOCK_IO_CLASS_CNT; c++) {
+        if (!rb_empty(&block->queue[c])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Accounts for the completion of request R, at time stamp NOW,
+ * in the statistics of BLOCK, which owns the queue R was in, and
+ * of the device R was submitted to.  BLOCK's queue lock must be
+ * held. */
+static void
+account_completion(struct block *block, const struct block_request *r,
+                   uint64_t now)
+{
+    struct block_class_stats *stats = &block->stats.classes[r->io_class];
+    struct block_op_stats *op = r->write ? &r->origin->stats.write
+                                         : &r->origin->stats.read;
+    uint64_t latency = now - r->submitted;
+
+    stats->requests++;
+    stats->depth--;
+    stats->latency += latency;
+    if (latency > stats->max_latency) {
+        stats->max_latency = latency;
+    }
+
+    op->completed++;
+    op->latency += latency;
+    if (latency > op->max_latency) {
+        op->max_latency = latency;
+    }
+    op->histogram[latency_bucket(latency)]++;
+}
+
+/* Has BLOCK's driver transfer CNT sectors starting at SECTOR to
+ * or from BUFFER. */
+static void
+driver_transfer(struct block *block, bool write, block_sector_t sector,
+                size_t cnt, void *buffer)
+{
+    const struct block_operations *ops = block->ops;
+    uint8_t *p = buffer;
+    size_t i;
+
+    if (write && ops->write_multiple != NULL) {
+        ops->write_multiple(block->aux, sector, cnt, buffer);
+    } else if (!write && ops->read_multiple != NULL) {
+        ops->read_multiple(block->aux, sector, cnt, buffer);
+    } else {
+        for (i = 0; i < cnt; i++, p += BLOCK_SECTOR_SIZE) {
+            if (write) {
+                ops->write(block->aux, sector + i, p);
+            } else {
+                ops->read(block->aux, sector + i, p);
+            }
+        }
+    }
+}
+
+/* I/O thread for device BLOCK_.  Serves the device's queue, one
+ * run of merged requests at a time, and runs their completion
+ * callbacks. */
+static void
+io_thread(void *block_)
+{
+    struct block *block = block_;
+
+    for (;;) {
+        struct block_request *r, *p;
+        size_t cnt;
+        uint64_t now;
+
+        lock_acquire(&block->queue_lock);
+        while (queue_empty(block)) {
+            cond_wait(&block->queue_ready, &block->queue_lock);
+        }
+        r = dequeue(block, &cnt);
+        lock_release(&block->queue_lock);
+
+        driver_transfer(block, r->write, r->sector, cnt, r->buffer);
+
+        now = rdtsc();
+        lock_acquire(&block->queue_lock);
+        for (p = r; p != NULL; p = p->merged) {
+            account_completion(block, p, now);
+        }
+        lock_release(&block->queue_lock);
+
+        while (r != NULL) {
+            struct block_request *next = r->merged;
+
+            r->done(r, r->aux);
+            r = next;
+        }
+    }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -159,20 +576,112 @@ block_type(struct block *block)
     return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Copies the current statistics of BLOCK into *STATS.  May be
+ * called at any time, except from an interrupt handler. */
+void
+block_get_stats(struct block *block, struct block_stats *stats)
+{
+    struct block *owner = queue_owner(block);
+
+    lock_acquire(&owner->queue_lock);
+    *stats = block->stats;
+    lock_release(&owner->queue_lock);
+}
+
+/* Prints statistics for each block device used for a Pintos role,
+ * then the detailed statistics of each device that has done any
+ * I/O. */
 void
 block_print_stats(void)
 {
+    struct block *block;
     int i;
 
     for (i = 0; i < BLOCK_ROLE_CNT; i++) {
-        struct block *block = block_by_role[i];
+        block = block_by_role[i];
         if (block != NULL) {
             printf("%s (%s): %llu reads, %llu writes\n",
                    block->name, block_type_name(block->type),
-                   block->read_cnt, block->write_cnt);
+                   block->stats.read.sectors, block->stats.write.sectors);
+        }
+    }
+    for (block = block_first(); block != NULL; block = block_next(block)) {
+        print_device_stats(block);
+    }
+}
+
+/* Prints the statistics in OP for operation NAME on BLOCK, if it
+ * has any requests. */
+static void
+print_op_stats(struct block *block, const char *name,
+               const struct block_op_stats *op)
+{
+    int i;
+
+    if (op->requests == 0) {
+        return;
+    }
+    printf("%s (%s) %ss: %llu requests, %llu sequential, "
+           "%llu sectors\n", block->name, block_type_name(block->type),
+           name, op->requests, op->sequential, op->sectors);
+    if (op->completed == 0) {
+        return;
+    }
+    printf("%s %s latency: avg %"PRIu64" max %"PRIu64" cycles;",
+           block->name, name, op->latency / op->completed, op->max_latency);
+    for (i = 0; i < BLOCK_LATENCY_BUCKETS; i++) {
+        if (op->histogram[i] != 0) {
+            printf(" 2^%d:%llu", i, op->histogram[i]);
         }
     }
+    printf("\n");
+}
+
+/* Prints the statistics of BLOCK, skipping those that are all
+ * zero.  Reads them without taking the queue lock, which may be
+ * held by a thread that will never run again when we are called
+ * to power off. */
+static void
+print_device_stats(struct block *block)
+{
+    static const char *class_names[BLOCK_IO_CLASS_CNT] =
+    {
+        "paging",
+        "normal",
+        "background",
+    };
+    const struct block_stats *stats = &block->stats;
+    bool queued = false;
+    int i;
+
+    print_op_stats(block, "read", &stats->read);
+    print_op_stats(block, "write", &stats->write);
+
+    for (i = 0; i < BLOCK_IO_CLASS_CNT; i++) {
+        const struct block_class_stats *c = &stats->classes[i];
+
+        if (c->requests > 0) {
+            printf("%s %s I/O: %llu requests, max queue depth %u, "
+                   "latency avg %"PRIu64" max %"PRIu64" cycles\n",
+                   block->name, class_names[i], c->requests,
+                   c->max_depth, c->latency / c->requests,
+                   c->max_latency);
+        }
+    }
+
+    for (i = 0; i < BLOCK_DEPTH_BUCKETS; i++) {
+        if (stats->depth_histogram[i] != 0) {
+            if (!queued) {
+                printf("%s queue depth at submit:", block->name);
+                queued = true;
+            }
+            printf(" %u:%llu", i > 0 ? 1u << (i - 1) : 0,
+                   stats->depth_histogram[i]);
+        }
+    }
+    if (queued) {
+        printf("\n");
+    }
 }
 
 /* Registers a new block device with the given NAME.  If
@@ -186,6 +695,7 @@ block_register(const char *name, enum block_type type,
                const struct block_operations *ops, void *aux)
 {
     struct block *block = malloc(sizeof *block);
+    int c;
 
     if (block == NULL) {
         PANIC("Failed to allocate memory for block device descriptor");
@@ -197,8 +707,18 @@ block_register(const char *name, enum block_type type,
     block->size = size;
     block->ops = ops;
     block->aux = aux;
-    block->read_cnt = 0;
-    block->write_cnt = 0;
+    memset(&block->stats, 0, sizeof block->stats);
+    block->next_sector[0] = block->next_sector[1] = 0;
+    block->whole = NULL;
+    block->start = 0;
+    lock_init(&block->queue_lock);
+    cond_init(&block->queue_ready);
+    for (c = 0; c < BLOCK_IO_CLASS_CNT; c++) {
+        rb_init(&block->queue[c], request_less, NULL, NULL);
+        block->passed_over[c] = 0;
+    }
+    block->queue_head = 0;
+    block->queue_thread = false;
 
     printf("%s: %'"PRDSNu " sectors (", block->name, block->size);
     print_human_readable_size((uint64_t)block->size * BLOCK_SECTOR_SIZE);
@@ -211,6 +731,19 @@ block_register(const char *name, enum block_type type,
     return block;
 }
 
+/* Makes BLOCK a partition that starts at sector START of WHOLE,
+ * so that requests to BLOCK join WHOLE's queue.  BLOCK's driver
+ * operations are not used after this. */
+void
+block_set_partition(struct block *block, struct block *whole,
+                    block_sector_t start)
+{
+    ASSERT(start + block->size <= whole->size);
+
+    block->whole = whole;
+    block->start = start;
+}
+
 /* Returns the block device corresponding to LIST_ELEM, or a null
  * pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block *
@@ -2,6 +2,8 @@
 #define DEVICES_BLOCK_H
 
 #include <inttypes.h>
+#include <rbtree.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 /* Size of a block device sector in bytes.
@@ -47,25 +49,145 @@ struct block *block_get_by_name(const char *name);
 struct block *block_first(void);
 struct block *block_next(struct block *);
 
+/* I/O priority class of a request.  The queue serves the classes
+ * in this order, except that a class passed over too many times
+ * in a row gets a turn, so that none starves. */
+enum block_io_class {
+    BLOCK_IO_PAGING,     /* Page-fault reads and writes. */
+    BLOCK_IO_NORMAL,     /* Everything else that a thread waits for. */
+    BLOCK_IO_BACKGROUND, /* Write-back and readahead. */
+    BLOCK_IO_CLASS_CNT
+};
+
 /* Block device operations. */
 block_sector_t block_size(struct block *);
 void block_read(struct block *, block_sector_t, void *);
 void block_write(struct block *, block_sector_t, const void *);
+void block_read_multiple(struct block *, block_sector_t, size_t cnt, void *);
+void block_write_multiple(struct block *, block_sector_t, size_t cnt,
+                          const void *);
+void block_transfer(struct block *, enum block_io_class, bool write,
+                    block_sector_t, size_t cnt, void *);
 const char *block_name(struct block *);
 enum block_type block_type(struct block *);
 
-/* Statistics. */
+/* Asynchronous requests.
+ *
+ * Each device has a queue of requests, served by its own I/O
+ * thread in C-LOOK order: in ascending sector order from where
+ * the last request ended, then back to the lowest sector.
+ * Adjacent requests in the same direction whose buffers are
+ * adjacent too are merged into a single driver call.  Requests
+ * to a partition join the queue of the device that contains it.
+ *
+ * Requests complete in queue order, not submission order, so a
+ * caller that needs one request to finish before another that
+ * overlaps it must wait for the first to complete. */
+
+struct block_request;
+
+/* Called in the device's I/O thread when request R completes,
+ * given the auxiliary data AUX passed to block_request_init().
+ * May submit more requests but must not wait for any, since the
+ * thread that would serve them is the one running it. */
+typedef void block_done_func(struct block_request *r, void *aux);
+
+/* A block request.  The submitter owns the storage, which must
+ * stay valid until the request completes.  The buffer must be in
+ * kernel memory, since the transfer runs in the device's I/O
+ * thread. */
+struct block_request {
+    /* Set by block_request_init(). */
+    bool                  write;  /* Write to the device? */
+    block_sector_t        sector; /* First sector. */
+    size_t                cnt;    /* Number of sectors. */
+    void                 *buffer; /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    block_done_func      *done;   /* Completion callback. */
+    void                 *aux;    /* Auxiliary data for `done'. */
+    enum block_io_class   io_class; /* BLOCK_IO_NORMAL, by default. */
+
+    /* Owned by block.c. */
+    struct rb_elem        elem;   /* Element in a device queue. */
+    struct block_request *merged; /* Next request merged into this one. */
+    struct block         *origin; /* Device the request was submitted to. */
+    uint64_t              submitted; /* Time stamp counter at submission. */
+};
+
+void block_request_init(struct block_request *, bool write,
+                        block_sector_t, size_t cnt, void *buffer,
+                        block_done_func *, void *aux);
+void block_request_set_class(struct block_request *, enum block_io_class);
+void block_submit(struct block *, struct block_request *);
+
+/* Statistics.
+ *
+ * Each device counts the requests submitted to it, so that the
+ * statistics of a partition show the I/O done for its role.
+ * Queue statistics belong to the device that owns the queue.
+ * Times are in time stamp counter cycles. */
+
+/* Number of buckets in a latency histogram.  Bucket I counts
+ * requests that took [2**I, 2**(I+1)) cycles, except that bucket
+ * 0 also counts 0 cycles and the last bucket counts everything
+ * longer. */
+#define BLOCK_LATENCY_BUCKETS 40
+
+/* Number of buckets in a queue depth histogram.  Bucket 0 counts
+ * an empty queue and bucket I > 0 depths in [2**(I-1), 2**I),
+ * except that the last bucket counts everything deeper. */
+#define BLOCK_DEPTH_BUCKETS 12
+
+/* Reads or writes submitted to one device. */
+struct block_op_stats {
+    unsigned long long requests;   /* Requests submitted. */
+    unsigned long long sectors;    /* Sectors in those requests. */
+    unsigned long long sequential; /* Requests that began where the
+                                    * previous one ended. */
+    unsigned long long completed;  /* Requests completed. */
+    uint64_t           latency;    /* Total cycles, submit to completion. */
+    uint64_t           max_latency; /* Longest cycles, submit to completion. */
+    unsigned long long histogram[BLOCK_LATENCY_BUCKETS]; /* Latencies. */
+};
+
+/* One I/O class of a device queue. */
+struct block_class_stats {
+    unsigned long long requests;    /* Requests completed. */
+    unsigned           depth;       /* Requests queued now. */
+    unsigned           max_depth;   /* Most requests ever queued. */
+    uint64_t           latency;     /* Total cycles, submit to completion. */
+    uint64_t           max_latency; /* Longest cycles, submit to completion. */
+};
+
+/* Statistics for one device. */
+struct block_stats {
+    struct block_op_stats    read;   /* Reads submitted to the device. */
+    struct block_op_stats    write;  /* Writes submitted to the device. */
+    struct block_class_stats classes[BLOCK_IO_CLASS_CNT]; /* Its queue. */
+    unsigned long long       depth_histogram[BLOCK_DEPTH_BUCKETS]; /* Queue
+                                      * depth found by each request. */
+};
+
+void block_get_stats(struct block *, struct block_stats *);
 void block_print_stats(void);
 
 /* Lower-level interface to block device drivers. */
 
+/* Driver operations.  READ_MULTIPLE and WRITE_MULTIPLE transfer
+ * CNT consecutive sectors and may be null, in which case the
+ * block layer falls back to one READ or WRITE per sector. */
 struct block_operations {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
 };
 
 struct block *block_register(const char *name, enum block_type,
                              const char *extra_info, block_sector_t size,
                              const struct block_operations *, void *aux);
+void block_set_partition(struct block *, struct block *whole,
+                         block_sector_t start);
 
 #endif /* devices/block.h */
@@ -9,7 +9,9 @@
 #include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
  * controller.  It attempts to comply to [ATA-3]. */
@@ -35,6 +37,7 @@
 #define STA_BSY  0x80 /* Busy. */
 #define STA_DRDY 0x40 /* Device Ready. */
 #define STA_DRQ  0x08 /* Data Request. */
+#define STA_ERR  0x01 /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04 /* Software Reset. */
@@ -50,13 +53,50 @@
 #define CMD_IDENTIFY_DEVICE    0xec /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY  0x20 /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30 /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE      0xc4 /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE     0xc5 /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE  0xc6 /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA           0xc8 /* READ DMA. */
+#define CMD_WRITE_DMA          0xca /* WRITE DMA. */
+
+/* Bus master IDE registers, relative to the channel's bus master
+ * base port.  See [PIIX] section 2.7 for the PIIX family that
+ * QEMU and Bochs emulate. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL)  ((CHANNEL)->bm_base + 2) /* Status. */
+#define reg_bm_prdt(CHANNEL)    ((CHANNEL)->bm_base + 4) /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01 /* Start transfer. */
+#define BM_CMD_READ  0x08 /* Transfer direction: 1=to memory. */
+
+/* Bus master Status Register bits. */
+#define BM_ST_ACTIVE 0x01 /* Transfer in progress. */
+#define BM_ST_ERROR  0x02 /* Transfer failed (write 1 to clear). */
+#define BM_ST_INTR   0x04 /* Device interrupted (write 1 to clear). */
+
+/* A Physical Region Descriptor: one physically contiguous piece
+ * of a DMA buffer, which may not cross a 64 kB boundary. */
+struct prd {
+    uint32_t addr;  /* Physical address. */
+    uint16_t size;  /* Size in bytes, with 0 meaning 64 kB. */
+    uint16_t flags; /* PRD_EOT on the last descriptor. */
+};
+#define PRD_EOT 0x8000 /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof(struct prd))
+
+/* Most sectors that one command can transfer: a sector count of
+ * 0 in the Sector Count register means 256. */
+#define MAX_CMD_SECTORS 256
 
 /* An ATA device. */
 struct ata_disk {
-    char            name[8]; /* Name, e.g. "hda". */
-    struct channel *channel; /* Channel that disk is attached to. */
-    int             dev_no;  /* Device 0 or 1 for master or slave. */
-    bool            is_ata;  /* Is device an ATA disk? */
+    char            name[8];  /* Name, e.g. "hda". */
+    struct channel *channel;  /* Channel that disk is attached to. */
+    int             dev_no;   /* Device 0 or 1 for master or slave. */
+    bool            is_ata;   /* Is device an ATA disk? */
+    int             multiple; /* Sectors per interrupt for READ/WRITE
+                               * MULTIPLE, or 0 if unsupported. */
 };
 
 /* An ATA channel (aka controller).
@@ -71,6 +111,10 @@ struct channel {
                                            * any interrupt would be spurious. */
     struct semaphore completion_wait;     /* Up'd by interrupt handler. */
 
+    uint16_t         bm_base;             /* Bus master base port, or 0 if the
+                                           * channel cannot do DMA. */
+    struct prd      *prdt;                /* PRD table, one page. */
+
     struct ata_disk  devices[2];          /* The devices on this channel. */
 };
 
@@ -84,10 +128,19 @@ static void reset_channel(struct channel *);
 static bool check_device_type(struct ata_disk *);
 static void identify_ata_device(struct ata_disk *);
 
-static void select_sector(struct ata_disk *, block_sector_t);
+static void select_sector(struct ata_disk *, block_sector_t, size_t cnt);
+static void set_multiple_mode(struct ata_disk *, int sectors);
 
 static void issue_pio_command(struct channel *, uint8_t command);
 
+static void pio_read(struct ata_disk *, block_sector_t, size_t cnt,
+                     void *buffer);
+static void pio_write(struct ata_disk *, block_sector_t, size_t cnt,
+                      const void *buffer);
+static bool dma_usable(const struct ata_disk *, const void *buffer);
+static void dma_transfer(struct ata_disk *, block_sector_t, size_t cnt,
+                         void *buffer, bool write);
+
 static void input_sector(struct channel *, void *);
 
 static void output_sector(struct channel *, const void *);
@@ -99,10 +152,13 @@ static void select_device_wait(const struct ata_disk *);
 
 static void interrupt_handler(struct intr_frame *);
 
+static uint16_t find_bus_master(void);
+
 /* Initialize the disk subsystem and detect disks. */
 void
 ide_init(void)
 {
+    uint16_t bm_base = find_bus_master();
     size_t chan_no;
 
     for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
@@ -127,6 +183,18 @@ ide_init(void)
         c->expecting_interrupt = false;
         sema_init(&c->completion_wait, 0);
 
+        /* Set up DMA, if the controller supports it.  The PRD
+         * table must not cross a 64 kB boundary, which a page
+         * never does. */
+        c->bm_base = 0;
+        c->prdt = NULL;
+        if (bm_base != 0) {
+            c->prdt = palloc_get_page(0);
+            if (c->prdt != NULL) {
+                c->bm_base = bm_base + chan_no * 8;
+            }
+        }
+
         /* Initialize devices. */
         for (dev_no = 0; dev_no < 2; dev_no++) {
             struct ata_disk *d = &c->devices[dev_no];
@@ -135,6 +203,7 @@ ide_init(void)
             d->channel = c;
             d->dev_no = dev_no;
             d->is_ata = false;
+            d->multiple = 0;
         }
 
         /* Register interrupt handler. */
@@ -297,6 +366,10 @@ identify_ata_device(struct ata_disk *d)
         return;
     }
 
+    /* The low byte of word 47 is the most sectors the disk can
+     * transfer per interrupt with READ/WRITE MULTIPLE. */
+    set_multiple_mode(d, (uint8_t)id[47 * 2]);
+
     /* Register. */
     block = block_register(d->name, BLOCK_RAW, extra_info, capacity,
                            &ide_operations, d);
@@ -330,67 +403,275 @@ descramble_ata_string(char *string, int size)
     return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
- * room for BLOCK_SECTOR_SIZE bytes.
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+ * BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+ * Uses bus-master DMA if the channel and BUFFER allow it,
+ * otherwise PIO.
  * Internally synchronizes accesses to disks, so external
  * per-disk locking is unneeded. */
 static void
-ide_read(void *d_, block_sector_t sec_no, void *buffer)
+ide_read_multiple(void *d_, block_sector_t sec_no, size_t cnt, void *buffer)
 {
     struct ata_disk *d = d_;
     struct channel *c = d->channel;
 
     lock_acquire(&c->lock);
-    select_sector(d, sec_no);
-    issue_pio_command(c, CMD_READ_SECTOR_RETRY);
-    sema_down(&c->completion_wait);
-    if (!wait_while_busy(d)) {
-        PANIC("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
+    if (dma_usable(d, buffer)) {
+        dma_transfer(d, sec_no, cnt, buffer, false);
+    } else {
+        pio_read(d, sec_no, cnt, buffer);
     }
-    input_sector(c, buffer);
     lock_release(&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
- * BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+ * BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes, as
+ * ide_read_multiple() reads them.  Returns after the disk has
  * acknowledged receiving the data.
  * Internally synchronizes accesses to disks, so external
  * per-disk locking is unneeded. */
 static void
-ide_write(void *d_, block_sector_t sec_no, const void *buffer)
+ide_write_multiple(void *d_, block_sector_t sec_no, size_t cnt,
+                   const void *buffer)
 {
     struct ata_disk *d = d_;
     struct channel *c = d->channel;
 
     lock_acquire(&c->lock);
-    select_sector(d, sec_no);
-    issue_pio_command(c, CMD_WRITE_SECTOR_RETRY);
-    if (!wait_while_busy(d)) {
-        PANIC("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
+    if (dma_usable(d, buffer)) {
+        dma_transfer(d, sec_no, cnt, (void *)buffer, true);
+    } else {
+        pio_write(d, sec_no, cnt, buffer);
     }
-    output_sector(c, buffer);
-    sema_down(&c->completion_wait);
     lock_release(&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+ * room for BLOCK_SECTOR_SIZE bytes.
+ * Internally synchronizes accesses to disks, so external
+ * per-disk locking is unneeded. */
+static void
+ide_read(void *d_, block_sector_t sec_no, void *buffer)
+{
+    ide_read_multiple(d_, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+ * BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+ * acknowledged receiving the data.
+ * Internally synchronizes accesses to disks, so external
+ * per-disk locking is unneeded. */
+static void
+ide_write(void *d_, block_sector_t sec_no, const void *buffer)
+{
+    ide_write_multiple(d_, sec_no, 1, buffer);
+}
+
 static struct block_operations ide_operations =
 {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
 };
 
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+ * BUFFER by PIO, using one command per MAX_CMD_SECTORS sectors:
+ * READ MULTIPLE, which interrupts once per D->multiple sectors,
+ * if D supports it, otherwise READ SECTOR, which interrupts once
+ * per sector.  D's channel must be locked. */
+static void
+pio_read(struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+         void *buffer)
+{
+    struct channel *c = d->channel;
+    uint8_t *p = buffer;
+
+    while (cnt > 0) {
+        size_t cmd_cnt = cnt < MAX_CMD_SECTORS ? cnt : MAX_CMD_SECTORS;
+        size_t per_intr = cmd_cnt > 1 && d->multiple > 1 ? d->multiple : 1;
+        size_t left;
+
+        select_sector(d, sec_no, cmd_cnt);
+        issue_pio_command(c, per_intr > 1 ? CMD_READ_MULTIPLE
+                                          : CMD_READ_SECTOR_RETRY);
+        for (left = cmd_cnt; left > 0; ) {
+            size_t n = left < per_intr ? left : per_intr;
+
+            sema_down(&c->completion_wait);
+            if (!wait_while_busy(d)) {
+                PANIC("%s: disk read failed, sector=%"PRDSNu,
+                      d->name, sec_no + (cmd_cnt - left));
+            }
+            for (; n > 0; n--, left--, p += BLOCK_SECTOR_SIZE) {
+                input_sector(c, p);
+            }
+        }
+        sec_no += cmd_cnt;
+        cnt -= cmd_cnt;
+    }
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+ * BUFFER by PIO, as pio_read() reads them.  D's channel must be
+ * locked. */
+static void
+pio_write(struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+          const void *buffer)
+{
+    struct channel *c = d->channel;
+    const uint8_t *p = buffer;
+
+    while (cnt > 0) {
+        size_t cmd_cnt = cnt < MAX_CMD_SECTORS ? cnt : MAX_CMD_SECTORS;
+        size_t per_intr = cmd_cnt > 1 && d->multiple > 1 ? d->multiple : 1;
+        size_t left;
+
+        select_sector(d, sec_no, cmd_cnt);
+        issue_pio_command(c, per_intr > 1 ? CMD_WRITE_MULTIPLE
+                                          : CMD_WRITE_SECTOR_RETRY);
+
+        /* The disk asks for the first block of data without an
+         * interrupt, and interrupts for each block after that and
+         * once more when it has taken the last. */
+        for (left = cmd_cnt; left > 0; ) {
+            size_t n = left < per_intr ? left : per_intr;
+
+            if (left != cmd_cnt) {
+                sema_down(&c->completion_wait);
+            }
+            if (!wait_while_busy(d)) {
+                PANIC("%s: disk write failed, sector=%"PRDSNu,
+                      d->name, sec_no + (cmd_cnt - left));
+            }
+            for (; n > 0; n--, left--, p += BLOCK_SECTOR_SIZE) {
+                output_sector(c, p);
+            }
+        }
+        sema_down(&c->completion_wait);
+        sec_no += cmd_cnt;
+        cnt -= cmd_cnt;
+    }
+}
+
+/* Returns true if D's channel can transfer BUFFER by DMA.  The
+ * controller needs physical addresses, which only kernel
+ * addresses translate to directly, and an even address. */
+static bool
+dma_usable(const struct ata_disk *d, const void *buffer)
+{
+    return (d->channel->bm_base != 0
+            && is_kernel_vaddr(buffer)
+            && ((uintptr_t)buffer & 1) == 0);
+}
+
+/* Fills D's channel's PRD table to describe the SIZE bytes at
+ * kernel address BUFFER, which is physically contiguous because
+ * the kernel maps physical memory linearly. */
+static void
+build_prdt(struct channel *c, void *buffer, size_t size)
+{
+    uintptr_t addr = vtop(buffer);
+    struct prd *prd = c->prdt;
+
+    ASSERT(size > 0);
+
+    for (;;) {
+        size_t boundary = 0x10000 - (addr & 0xffff);
+        size_t n = size < boundary ? size : boundary;
+
+        ASSERT(prd < c->prdt + PRD_CNT);
+        prd->addr = addr;
+        prd->size = n;
+        prd->flags = 0;
+        addr += n;
+        size -= n;
+        if (size == 0) {
+            break;
+        }
+        prd++;
+    }
+    prd->flags = PRD_EOT;
+}
+
+/* Transfers the CNT sectors starting at SEC_NO between disk D and
+ * BUFFER by bus-master DMA, writing to the disk if WRITE is true
+ * and reading from it otherwise, with one command and one
+ * interrupt per MAX_CMD_SECTORS sectors.  The CPU does not touch
+ * the data.  D's channel must be locked. */
+static void
+dma_transfer(struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+             void *buffer, bool write)
+{
+    struct channel *c = d->channel;
+    uint8_t direction = write ? 0 : BM_CMD_READ;
+    uint8_t *p = buffer;
+
+    while (cnt > 0) {
+        size_t cmd_cnt = cnt < MAX_CMD_SECTORS ? cnt : MAX_CMD_SECTORS;
+        uint8_t status;
+
+        build_prdt(c, p, cmd_cnt * BLOCK_SECTOR_SIZE);
+        outl(reg_bm_prdt(c), vtop(c->prdt));
+        outb(reg_bm_command(c), direction);
+        outb(reg_bm_status(c), BM_ST_ERROR | BM_ST_INTR);
+
+        select_sector(d, sec_no, cmd_cnt);
+        issue_pio_command(c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+        outb(reg_bm_command(c), direction | BM_CMD_START);
+        sema_down(&c->completion_wait);
+        outb(reg_bm_command(c), direction);
+
+        status = inb(reg_bm_status(c));
+        if ((status & BM_ST_ERROR) != 0
+            || (inb(reg_alt_status(c)) & STA_ERR) != 0) {
+            PANIC("%s: disk %s failed, sector=%"PRDSNu,
+                  d->name, write ? "DMA write" : "DMA read", sec_no);
+        }
+
+        p += cmd_cnt * BLOCK_SECTOR_SIZE;
+        sec_no += cmd_cnt;
+        cnt -= cmd_cnt;
+    }
+}
+
+/* Enables READ/WRITE MULTIPLE on disk D with SECTORS sectors per
+ * interrupt, as reported by IDENTIFY DEVICE.  Leaves them
+ * disabled if SECTORS is less than 2 or the disk refuses. */
+static void
+set_multiple_mode(struct ata_disk *d, int sectors)
+{
+    struct channel *c = d->channel;
+
+    d->multiple = 0;
+    if (sectors < 2) {
+        return;
+    }
+
+    select_device_wait(d);
+    outb(reg_nsect(c), sectors);
+    issue_pio_command(c, CMD_SET_MULTIPLE_MODE);
+    sema_down(&c->completion_wait);
+    wait_while_busy(d);
+    if ((inb(reg_status(c)) & STA_ERR) == 0) {
+        d->multiple = sectors;
+    }
+}
+
 /* Selects device D, waiting for it to become ready, and then
- * writes SEC_NO to the disk's sector selection registers.  (We
- * use LBA mode.) */
+ * writes SEC_NO and the sector count CNT, which must be between
+ * 1 and MAX_CMD_SECTORS, to the disk's sector selection
+ * registers.  (We use LBA mode.) */
 static void
-select_sector(struct ata_disk *d, block_sector_t sec_no)
+select_sector(struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
     struct channel *c = d->channel;
 
     ASSERT(sec_no < (1UL << 28));
+    ASSERT(cnt >= 1 && cnt <= MAX_CMD_SECTORS);
 
     select_device_wait(d);
-    outb(reg_nsect(c), 1);
+    outb(reg_nsect(c), cnt);
     outb(reg_lbal(c), sec_no);
     outb(reg_lbam(c), sec_no >> 8);
     outb(reg_lbah(c), (sec_no >> 16));
@@ -511,6 +792,10 @@ interrupt_handler(struct intr_frame *f)
         if (f->vec_no == c->irq) {
             if (c->expecting_interrupt) {
                 inb(reg_status(c));           /* Acknowledge interrupt. */
+                if (c->bm_base != 0) {
+                    /* Acknowledge bus master, in case of DMA. */
+                    outb(reg_bm_status(c), BM_ST_INTR);
+                }
                 sema_up(&c->completion_wait); /* Wake up waiter. */
             } else {
                 printf("%s: unexpected interrupt\n", c->name);
@@ -521,3 +806,73 @@ interrupt_handler(struct intr_frame *f)
 
     NOT_REACHED();
 }
+
+/* PCI configuration space access, just enough to find the IDE
+ * controller's bus master registers.  See [PCI] section 3.2.2.3.2. */
+#define PCI_CONFIG_ADDRESS 0xcf8
+#define PCI_CONFIG_DATA    0xcfc
+
+/* Returns the 32-bit word at offset REG in the configuration
+ * space of PCI function FUNC of device DEV on bus 0. */
+static uint32_t
+pci_read_config(int dev, int func, int reg)
+{
+    outl(PCI_CONFIG_ADDRESS, 0x80000000 | (dev << 11) | (func << 8) | reg);
+    return inl(PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit word at offset REG in the
+ * configuration space of PCI function FUNC of device DEV on bus
+ * 0. */
+static void
+pci_write_config(int dev, int func, int reg, uint32_t value)
+{
+    outl(PCI_CONFIG_ADDRESS, 0x80000000 | (dev << 11) | (func << 8) | reg);
+    outl(PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that can act as bus
+ * master, such as the PIIX3 that QEMU and Bochs emulate.  If one
+ * is found, enables bus mastering and returns the base I/O port
+ * of its bus master registers, whose first 8 ports serve the
+ * primary channel and next 8 the secondary.  Otherwise returns 0,
+ * and the driver uses PIO only. */
+static uint16_t
+find_bus_master(void)
+{
+    int dev, func;
+
+    for (dev = 0; dev < 32; dev++) {
+        for (func = 0; func < 8; func++) {
+            uint32_t id = pci_read_config(dev, func, 0x00);
+            uint32_t class = pci_read_config(dev, func, 0x08);
+            uint32_t bar4;
+
+            if ((id & 0xffff) == 0xffff) {
+                /* No such function. */
+                continue;
+            }
+
+            /* Class 01h (mass storage), subclass 01h (IDE), with
+             * bit 7 of the programming interface for bus master
+             * support. */
+            if ((class >> 16) != 0x0101 || (class & 0x8000) == 0) {
+                continue;
+            }
+
+            /* BAR4 holds the bus master base, in I/O space. */
+            bar4 = pci_read_config(dev, func, 0x20);
+            if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0) {
+                continue;
+            }
+
+            /* Set the Bus Master Enable bit in the Command
+             * register, preserving the Status half of the word. */
+            pci_write_config(dev, func, 0x04,
+                             (pci_read_config(dev, func, 0x04) & 0xffff)
+                             | 0x04);
+            return bar4 & 0xfffc;
+        }
+    }
+    return 0;
+}
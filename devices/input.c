@@ -3,15 +3,27 @@
 #include "devices/input.h"
 #include "devices/intq.h"
 #include "devices/serial.h"
+#include "threads/synch.h"
+
+/* Size of the input buffer, in bytes.  Must be a power of 2. */
+#define INPUT_BUFSIZE 256
 
 /* Stores keys from the keyboard and serial port. */
 static struct intq buffer;
+static uint8_t buffer_data[INPUT_BUFSIZE];
+
+/* Serializes readers, since the buffer allows only one consumer
+ * at a time. */
+static struct lock read_lock;
+
+static bool is_eol(uint8_t);
 
 /* Initializes the input buffer. */
 void
 input_init(void)
 {
-    intq_init(&buffer);
+    intq_init(&buffer, buffer_data, sizeof buffer_data);
+    lock_init(&read_lock);
 }
 
 /* Adds a key to the input buffer.
@@ -34,14 +46,62 @@ input_getc(void)
     enum intr_level old_level;
     uint8_t key;
 
-    old_level = intr_disable();
+    lock_acquire(&read_lock);
     key = intq_getc(&buffer);
+    old_level = intr_disable();
     serial_notify();
     intr_set_level(old_level);
+    lock_release(&read_lock);
 
     return key;
 }
 
+/* Reads up to SIZE keys from the input buffer into BUF and
+ * returns the number read.  Takes whatever keys are already
+ * there, but stops after the first end of line, so that a reader
+ * gets one line at a time.  If the buffer is empty, waits for a
+ * key to be pressed if BLOCK is true, and otherwise returns 0
+ * at once.  BUF must be kernel memory: a page fault while the
+ * read lock is held could kill the process and leave the lock
+ * held forever. */
+size_t
+input_read(uint8_t *buf, size_t size, bool block)
+{
+    enum intr_level old_level;
+    size_t cnt = 0;
+
+    if (size == 0) {
+        return 0;
+    }
+
+    lock_acquire(&read_lock);
+    if (block || !intq_empty(&buffer)) {
+        buf[cnt++] = intq_getc(&buffer);
+        if (!is_eol(buf[0])) {
+            size_t avail = intq_used(&buffer);
+            size_t n;
+
+            if (avail > size - 1) {
+                avail = size - 1;
+            }
+            for (n = 0; n < avail && !is_eol(intq_peek(&buffer, n)); n++) {
+                continue;
+            }
+            if (n < avail) {
+                n++; /* Include the end of line. */
+            }
+            cnt += intq_read(&buffer, buf + 1, n);
+        }
+
+        old_level = intr_disable();
+        serial_notify();
+        intr_set_level(old_level);
+    }
+    lock_release(&read_lock);
+
+    return cnt;
+}
+
 /* Returns true if the input buffer is full,
  * false otherwise.
  * Interrupts must be off. */
@@ -51,3 +111,12 @@ input_full(void)
     ASSERT(intr_get_level() == INTR_OFF);
     return intq_full(&buffer);
 }
+
+/* Returns true if KEY ends a line of input.  The keyboard sends
+ * a carriage return for Enter; a serial terminal may send
+ * either. */
+static bool
+is_eol(uint8_t key)
+{
+    return key == '\r' || key == '\n';
+}
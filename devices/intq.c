@@ -1,36 +1,61 @@
 #include <debug.h>
+#include <string.h>
 
 #include "devices/intq.h"
 #include "threads/thread.h"
 
-static int next(int pos);
-
 static void wait(struct intq *q, struct thread **waiter);
 static void signal(struct intq *q, struct thread **waiter);
 
-/* Initializes interrupt queue Q. */
+/* Initializes interrupt queue Q to use the SIZE bytes at BUF,
+ * which must be a power of 2. */
 void
-intq_init(struct intq *q)
+intq_init(struct intq *q, uint8_t *buf, size_t size)
 {
+    ASSERT(buf != NULL);
+    ASSERT(size > 0 && (size & (size - 1)) == 0);
+
     lock_init(&q->lock);
     q->not_full = q->not_empty = NULL;
+    q->buf = buf;
+    q->mask = size - 1;
     q->head = q->tail = 0;
 }
 
+/* Returns the number of bytes in Q. */
+size_t
+intq_used(const struct intq *q)
+{
+    unsigned head = q->head;
+    unsigned tail = q->tail;
+
+    barrier();
+    return head - tail;
+}
+
 /* Returns true if Q is empty, false otherwise. */
 bool
 intq_empty(const struct intq *q)
 {
-    ASSERT(intr_get_level() == INTR_OFF);
-    return q->head == q->tail;
+    return intq_used(q) == 0;
 }
 
 /* Returns true if Q is full, false otherwise. */
 bool
 intq_full(const struct intq *q)
 {
-    ASSERT(intr_get_level() == INTR_OFF);
-    return next(q->head) == q->tail;
+    return intq_used(q) > q->mask;
+}
+
+/* Returns the byte OFS bytes from the front of Q without
+ * removing it.  Q must hold more than OFS bytes.  Only the
+ * consumer may call this. */
+uint8_t
+intq_peek(const struct intq *q, size_t ofs)
+{
+    ASSERT(ofs < intq_used(q));
+
+    return q->buf[(q->tail + ofs) & q->mask];
 }
 
 /* Removes a byte from Q and returns it.
@@ -41,16 +66,13 @@ intq_getc(struct intq *q)
 {
     uint8_t byte;
 
-    ASSERT(intr_get_level() == INTR_OFF);
-    while (intq_empty(q)) {
-        ASSERT(!intr_context());
-        lock_acquire(&q->lock);
+    if (intq_empty(q)) {
         wait(q, &q->not_empty);
-        lock_release(&q->lock);
     }
 
-    byte = q->buf[q->tail];
-    q->tail = next(q->tail);
+    byte = q->buf[q->tail & q->mask];
+    barrier();
+    q->tail++;
     signal(q, &q->not_full);
     return byte;
 }
@@ -61,38 +83,99 @@ intq_getc(struct intq *q)
 void
 intq_putc(struct intq *q, uint8_t byte)
 {
-    ASSERT(intr_get_level() == INTR_OFF);
-    while (intq_full(q)) {
-        ASSERT(!intr_context());
-        lock_acquire(&q->lock);
+    if (intq_full(q)) {
         wait(q, &q->not_full);
-        lock_release(&q->lock);
     }
 
-    q->buf[q->head] = byte;
-    q->head = next(q->head);
+    q->buf[q->head & q->mask] = byte;
+    barrier();
+    q->head++;
     signal(q, &q->not_empty);
 }
 
-/* Returns the position after POS within an intq. */
-static int
-next(int pos)
+/* Removes up to CNT bytes from Q into BUF without waiting, and
+ * returns the number removed.  Wakes a thread waiting for room
+ * at most once, so this is cheaper than calling intq_getc() for
+ * each byte. */
+size_t
+intq_read(struct intq *q, uint8_t *buf, size_t cnt)
 {
-    return (pos + 1) % INTQ_BUFSIZE;
+    size_t used = intq_used(q);
+    size_t ofs = q->tail & q->mask;
+    size_t first;
+
+    if (cnt > used) {
+        cnt = used;
+    }
+    if (cnt == 0) {
+        return 0;
+    }
+
+    /* Copy up to the end of the buffer, then from its start. */
+    first = q->mask + 1 - ofs;
+    if (first > cnt) {
+        first = cnt;
+    }
+    memcpy(buf, q->buf + ofs, first);
+    memcpy(buf + first, q->buf, cnt - first);
+    barrier();
+    q->tail += cnt;
+    signal(q, &q->not_full);
+    return cnt;
+}
+
+/* Adds as many of the CNT bytes in BUF to the end of Q as fit
+ * without waiting, and returns the number added.  Wakes a thread
+ * waiting for Q to become non-empty at most once, so this is
+ * cheaper than calling intq_putc() for each byte. */
+size_t
+intq_write(struct intq *q, const uint8_t *buf, size_t cnt)
+{
+    size_t room = q->mask + 1 - intq_used(q);
+    size_t ofs = q->head & q->mask;
+    size_t first;
+
+    if (cnt > room) {
+        cnt = room;
+    }
+    if (cnt == 0) {
+        return 0;
+    }
+
+    /* Copy up to the end of the buffer, then to its start. */
+    first = q->mask + 1 - ofs;
+    if (first > cnt) {
+        first = cnt;
+    }
+    memcpy(q->buf + ofs, buf, first);
+    memcpy(q->buf, buf + first, cnt - first);
+    barrier();
+    q->head += cnt;
+    signal(q, &q->not_empty);
+    return cnt;
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
- * member.  Waits until the given condition is true. */
+ * member.  Waits until the given condition is true.  Checks the
+ * condition again with interrupts off before sleeping, so that a
+ * byte moved by the other side after the caller's check cannot
+ * be missed. */
 static void
-wait(struct intq *q UNUSED, struct thread **waiter)
+wait(struct intq *q, struct thread **waiter)
 {
+    enum intr_level old_level;
+
     ASSERT(!intr_context());
-    ASSERT(intr_get_level() == INTR_OFF);
-    ASSERT((waiter == &q->not_empty && intq_empty(q))
-           || (waiter == &q->not_full && intq_full(q)));
+    ASSERT(waiter == &q->not_empty || waiter == &q->not_full);
 
-    *waiter = thread_current();
-    thread_block();
+    lock_acquire(&q->lock);
+    old_level = intr_disable();
+    while (waiter == &q->not_empty ? intq_empty(q) : intq_full(q)) {
+        *waiter = thread_current();
+        thread_block();
+    }
+    intr_set_level(old_level);
+    lock_release(&q->lock);
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
@@ -102,12 +185,19 @@ wait(struct intq *q UNUSED, struct thread **waiter)
 static void
 signal(struct intq *q UNUSED, struct thread **waiter)
 {
-    ASSERT(intr_get_level() == INTR_OFF);
-    ASSERT((waiter == &q->not_empty && !intq_empty(q))
-           || (waiter == &q->not_full && !intq_full(q)));
+    enum intr_level old_level;
+
+    ASSERT(waiter == &q->not_empty || waiter == &q->not_full);
 
+    /* The index was published before this read, so a waiter that
+     * we miss here will see the new index before it sleeps. */
+    barrier();
     if (*waiter != NULL) {
-        thread_unblock(*waiter);
-        *waiter = NULL;
+        old_level = intr_disable();
+        if (*waiter != NULL) {
+            thread_unblock(*waiter);
+            *waiter = NULL;
+        }
+        intr_set_level(old_level);
     }
 }
@@ -1,25 +1,33 @@
 #ifndef DEVICES_INTQ_H
 #define DEVICES_INTQ_H
 
+#include <stddef.h>
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 
 /* An "interrupt queue", a circular buffer shared between
  * kernel threads and external interrupt handlers.
  *
- * Interrupt queue functions can be called from kernel threads or
- * from external interrupt handlers.  Except for intq_init(),
- * interrupts must be off in either case.
+ * The queue has a single producer and a single consumer: at any
+ * time, at most one context adds bytes and at most one removes
+ * them, although which thread or handler does so may change.
+ * Under that rule the producer and consumer need no lock and
+ * need not turn off interrupts to move bytes, since each
+ * advances only its own index and publishes it after the data.
+ * Interrupts are turned off only briefly, to put a thread to
+ * sleep or wake it up.
  *
- * The interrupt queue has the structure of a "monitor".  Locks
- * and condition variables from threads/synch.h cannot be used in
+ * intq_read() and intq_write() move a batch of bytes without
+ * waiting.  intq_getc() and intq_putc() move a single byte,
+ * waiting for room or data if necessary; only a kernel thread
+ * may wait, so an interrupt handler must check first.
+ *
+ * The waiting side has the structure of a "monitor".  Locks and
+ * condition variables from threads/synch.h cannot be used in
  * this case, as they normally would, because they can only
  * protect kernel threads from one another, not from interrupt
  * handlers. */
 
-/* Queue buffer size, in bytes. */
-#define INTQ_BUFSIZE 64
-
 /* A circular queue of bytes. */
 struct intq {
     /* Waiting threads. */
@@ -28,15 +36,20 @@ struct intq {
     struct thread *not_empty; /* Thread waiting for not-empty condition. */
 
     /* Queue. */
-    uint8_t buf[INTQ_BUFSIZE]; /* Buffer. */
-    int     head;              /* New data is written here. */
-    int     tail;              /* Old data is read here. */
+    uint8_t  *buf;  /* Buffer, a power of 2 bytes long. */
+    size_t    mask; /* Buffer size minus 1. */
+    unsigned  head; /* Bytes ever added; written only by producer. */
+    unsigned  tail; /* Bytes ever removed; written only by consumer. */
 };
 
-void intq_init(struct intq *);
+void intq_init(struct intq *, uint8_t *buf, size_t size);
 bool intq_empty(const struct intq *);
 bool intq_full(const struct intq *);
+size_t intq_used(const struct intq *);
+uint8_t intq_peek(const struct intq *, size_t ofs);
 uint8_t intq_getc(struct intq *);
 void intq_putc(struct intq *, uint8_t);
+size_t intq_read(struct intq *, uint8_t *, size_t cnt);
+size_t intq_write(struct intq *, const uint8_t *, size_t cnt);
 
 #endif /* devices/intq.h */
@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include "devices/input.h"
+#include "devices/intq.h"
 #include "devices/kbd.h"
 #include "devices/shutdown.h"
 #include "threads/interrupt.h"
@@ -25,12 +26,25 @@ static bool caps_lock;
 /* Number of keys pressed. */
 static int64_t key_cnt;
 
+/* Scancodes read by the interrupt handler and not yet decoded.
+ * Must be a power of 2 bytes. */
+#define SCANCODE_BUFSIZE 64
+static struct intq scancodes;
+static uint8_t scancode_data[SCANCODE_BUFSIZE];
+
+/* Decodes scancodes once interrupts are back on. */
+static struct softirq decode_softirq;
+
 static intr_handler_func keyboard_interrupt;
+static softirq_func keyboard_softirq;
+static void decode_scancode(unsigned code);
 
 /* Initializes the keyboard. */
 void
 kbd_init(void)
 {
+    intq_init(&scancodes, scancode_data, sizeof scancode_data);
+    softirq_init(&decode_softirq, "keyboard", keyboard_softirq, NULL);
     intr_register_ext(0x21, keyboard_interrupt, "8042 Keyboard");
 }
 
@@ -94,27 +108,55 @@ static bool map_key(const struct keymap[], unsigned scancode, uint8_t *);
 
 static void
 keyboard_interrupt(struct intr_frame *args UNUSED)
+{
+    uint8_t code[2];
+    size_t cnt = 1;
+
+    /* Read scancode, including second byte if prefix code, and
+     * leave decoding it to keyboard_softirq().  If there is no
+     * room, the key is lost, as it would be if the input buffer
+     * were full. */
+    code[0] = inb(DATA_REG);
+    if (code[0] == 0xe0) {
+        code[cnt++] = inb(DATA_REG);
+    }
+    if (intq_used(&scancodes) + cnt <= SCANCODE_BUFSIZE) {
+        intq_write(&scancodes, code, cnt);
+        softirq_raise(&decode_softirq);
+    }
+}
+
+/* Decodes the scancodes queued by keyboard_interrupt(). */
+static void
+keyboard_softirq(void *aux UNUSED)
+{
+    while (!intq_empty(&scancodes)) {
+        unsigned code = intq_getc(&scancodes);
+
+        /* A prefix code's second byte was queued with it. */
+        if (code == 0xe0) {
+            code = (code << 8) | intq_getc(&scancodes);
+        }
+        decode_scancode(code);
+    }
+}
+
+/* Interprets keyboard scancode CODE, updating the state of the
+ * shift keys or adding a character to the input buffer. */
+static void
+decode_scancode(unsigned code)
 {
     /* Status of shift keys. */
     bool shift = left_shift || right_shift;
     bool alt = left_alt || right_alt;
     bool ctrl = left_ctrl || right_ctrl;
 
-    /* Keyboard scancode. */
-    unsigned code;
-
     /* False if key pressed, true if key released. */
     bool release;
 
     /* Character that corresponds to `code'. */
     uint8_t c;
 
-    /* Read scancode, including second byte if prefix code. */
-    code = inb(DATA_REG);
-    if (code == 0xe0) {
-        code = (code << 8) | inb(DATA_REG);
-    }
-
     /* Bit 0x80 distinguishes key press from key release
      * (even if there's a prefix). */
     release = (code & 0x80) != 0;
@@ -131,6 +173,8 @@ keyboard_interrupt(struct intr_frame *args UNUSED)
                || (shift && map_key(shifted_keymap, code, &c))) {
         /* Ordinary character. */
         if (!release) {
+            enum intr_level old_level;
+
             /* Reboot if Ctrl+Alt+Del pressed. */
             if (c == 0177 && ctrl && alt) {
                 shutdown_reboot();
@@ -153,10 +197,12 @@ keyboard_interrupt(struct intr_frame *args UNUSED)
             }
 
             /* Append to keyboard buffer. */
+            old_level = intr_disable();
             if (!input_full()) {
                 key_cnt++;
                 input_putc(c);
             }
+            intr_set_level(old_level);
         }
     } else {
         /* Maps a keycode into a shift state variable. */
@@ -174,7 +174,9 @@ found_partition(struct block *block, uint8_t part_type,
         snprintf(name, sizeof name, "%s%d", block_name(block), part_nr);
         snprintf(extra_info, sizeof extra_info, "%s (%02x)",
                  partition_type_name(part_type), part_type);
-        block_register(name, type, extra_info, size, &partition_operations, p);
+        block_set_partition(block_register(name, type, extra_info, size,
+                                           &partition_operations, p),
+                            block, start);
     }
 }
 
@@ -312,8 +314,34 @@ partition_write(void *p_, block_sector_t sector, const void *buffer)
     block_write(p->block, p->start + sector, buffer);
 }
 
+/* Reads the CNT sectors starting at SECTOR from partition P into
+ * BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+ * bytes. */
+static void
+partition_read_multiple(void *p_, block_sector_t sector, size_t cnt,
+                        void *buffer)
+{
+    struct partition *p = p_;
+
+    block_read_multiple(p->block, p->start + sector, cnt, buffer);
+}
+
+/* Writes the CNT sectors starting at SECTOR to partition P from
+ * BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+ * Returns after the block has acknowledged receiving the data. */
+static void
+partition_write_multiple(void *p_, block_sector_t sector, size_t cnt,
+                         const void *buffer)
+{
+    struct partition *p = p_;
+
+    block_write_multiple(p->block, p->start + sector, cnt, buffer);
+}
+
 static struct block_operations partition_operations =
 {
     partition_read,
-    partition_write
+    partition_write,
+    partition_read_multiple,
+    partition_write_multiple
 };
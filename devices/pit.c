@@ -12,9 +12,6 @@
 #define PIT_PORT_CONTROL 0x43                        /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL)) /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
  * three output channels are hooked up like this:
  *
@@ -79,3 +76,42 @@ pit_configure_channel(int channel, int mode, int frequency)
     outb(PIT_PORT_COUNTER(channel), count >> 8);
     intr_set_level(old_level);
 }
+
+/* Starts CHANNEL counting down once from COUNT, in mode 0.  For
+ * channel 0, the interrupt comes when the count reaches 0, COUNT
+ * PIT cycles from now.  The channel then keeps counting down
+ * from 65535 but raises no more interrupts, until it is
+ * reconfigured. */
+void
+pit_start_oneshot(int channel, uint16_t count)
+{
+    enum intr_level old_level;
+
+    ASSERT(channel == 0);
+    ASSERT(count != 0);
+
+    old_level = intr_disable();
+    outb(PIT_PORT_CONTROL, (channel << 6) | 0x30);
+    outb(PIT_PORT_COUNTER(channel), count);
+    outb(PIT_PORT_COUNTER(channel), count >> 8);
+    intr_set_level(old_level);
+}
+
+/* Returns the current count of CHANNEL, which counts down by one
+ * each PIT cycle. */
+uint16_t
+pit_read_count(int channel)
+{
+    enum intr_level old_level;
+    uint16_t count;
+
+    ASSERT(channel == 0 || channel == 2);
+
+    /* Latch the count, then read it low byte first. */
+    old_level = intr_disable();
+    outb(PIT_PORT_CONTROL, channel << 6);
+    count = inb(PIT_PORT_COUNTER(channel));
+    count |= inb(PIT_PORT_COUNTER(channel)) << 8;
+    intr_set_level(old_level);
+    return count;
+}
@@ -52,13 +52,23 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
+/* Size of the transmit queue, in bytes.  Must be a power of 2.
+ * At 9,600 bps this is about half a second of output. */
+#define TXQ_SIZE 512
+
 /* Data to be transmitted. */
 static struct intq txq;
+static uint8_t txq_data[TXQ_SIZE];
+
+/* Most bytes serial_putbuf() sends per interrupts-off section. */
+#define PUTBUF_CHUNK 64
 
 static void set_serial(int bps);
 
 static void putc_poll(uint8_t);
 
+static void putbuf_chunk(const uint8_t *, size_t cnt);
+
 static void write_ier(void);
 
 static intr_handler_func serial_interrupt;
@@ -75,7 +85,7 @@ init_poll(void)
     outb(FCR_REG, 0);        /* Disable FIFO. */
     set_serial(9600);        /* 9.6 kbps, N-8-1. */
     outb(MCR_REG, MCR_OUT2); /* Required to enable interrupts. */
-    intq_init(&txq);
+    intq_init(&txq, txq_data, sizeof txq_data);
     mode = POLL;
 }
 
@@ -131,6 +141,61 @@ serial_putc(uint8_t byte)
     intr_set_level(old_level);
 }
 
+/* Sends the CNT bytes in BUF to the serial port.  Queues them in
+ * as few batches as the transmit queue allows, updating the
+ * interrupt enable register once per batch rather than once per
+ * byte.  Interrupts are turned off for at most PUTBUF_CHUNK bytes
+ * at a time, so a long write does not hold off the timer. */
+void
+serial_putbuf(const uint8_t *buf, size_t cnt)
+{
+    while (cnt > 0) {
+        size_t n = cnt < PUTBUF_CHUNK ? cnt : PUTBUF_CHUNK;
+
+        putbuf_chunk(buf, n);
+        buf += n;
+        cnt -= n;
+    }
+}
+
+/* Sends the CNT bytes in BUF to the serial port with interrupts
+ * off.  Helper for serial_putbuf(). */
+static void
+putbuf_chunk(const uint8_t *buf, size_t cnt)
+{
+    enum intr_level old_level = intr_disable();
+
+    if (mode != QUEUE) {
+        if (mode == UNINIT) {
+            init_poll();
+        }
+        while (cnt-- > 0) {
+            putc_poll(*buf++);
+        }
+    } else {
+        while (cnt > 0) {
+            size_t n = intq_write(&txq, buf, cnt);
+
+            buf += n;
+            cnt -= n;
+            write_ier();
+            if (cnt > 0) {
+                /* The transmit queue is full.  As in serial_putc(),
+                 * poll out a byte if interrupts are off, otherwise
+                 * wait for the interrupt handler to make room. */
+                if (old_level == INTR_OFF) {
+                    putc_poll(intq_getc(&txq));
+                } else {
+                    intq_putc(&txq, *buf++);
+                    cnt--;
+                }
+            }
+        }
+    }
+
+    intr_set_level(old_level);
+}
+
 /* Flushes anything in the serial buffer out the port in polling
  * mode. */
 void
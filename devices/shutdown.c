@@ -5,7 +5,10 @@
 #include "devices/serial.h"
 #include "devices/shutdown.h"
 #include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
@@ -14,6 +17,9 @@
 #include "devices/block.h"
 #include "filesys/filesys.h"
 #endif
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Keyboard control register port. */
 #define CONTROL_REG 0x64
@@ -128,7 +134,10 @@ static void
 print_stats(void)
 {
     timer_print_stats();
+    intr_print_stats();
     thread_print_stats();
+    palloc_print_stats();
+    kmem_cache_print_stats();
 #ifdef FILESYS
     block_print_stats();
 #endif
@@ -137,4 +146,7 @@ print_stats(void)
 #ifdef USERPROG
     exception_print_stats();
 #endif
+#ifdef VM
+    page_print_stats();
+#endif
 }
@@ -1,4 +1,5 @@
 #include <debug.h>
+#include <heap.h>
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
@@ -21,11 +22,79 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* Threads in timer_sleep(), ordered by wake_tick.  Accessed only
+ * with interrupts off. */
+static struct heap sleepers;
+
+/* Hierarchical timing wheel for struct timer [Varghese87].
+ *
+ * Level 0 has one slot per tick for the next WHEEL_SLOTS ticks.
+ * Each slot of level L covers WHEEL_SLOTS**L ticks, so the
+ * WHEEL_LEVELS levels together reach WHEEL_SPAN ticks ahead.
+ * Adding a timer is O(1): it goes into the slot of the lowest
+ * level that reaches its expiry.  Each tick moves the whole
+ * level-0 slot for that tick onto the expiry list at once.
+ * Whenever the level-L index wraps around to 0, the next slot of
+ * level L + 1 is "cascaded", redistributing its timers into the
+ * levels below, which now reach far enough to hold them.
+ *
+ * The wheel and the expiry list are accessed only with
+ * interrupts off. */
+#define WHEEL_BITS 6                            /* Bits of index per level. */
+#define WHEEL_SLOTS (1 << WHEEL_BITS)           /* Slots per level. */
+#define WHEEL_MASK (WHEEL_SLOTS - 1)            /* Slot index mask. */
+#define WHEEL_LEVELS 4                          /* Number of levels. */
+#define WHEEL_SPAN ((int64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+static struct list wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static int64_t wheel_tick; /* Next tick to process. */
+
+/* Expired timers whose callbacks have not run yet, and the
+ * semaphore that wakes the timer thread to run them. */
+static struct list expired;
+static struct semaphore expired_sema;
+
+/* If false (default), the timer interrupts TIMER_FREQ times per
+ * second, always.  If true, the idle thread stretches the gap
+ * between interrupts up to the next timer deadline.  Controlled
+ * by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* PIT cycles per timer tick. */
+#define TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Longest idle stretch, in ticks, that fits in the PIT's 16-bit
+ * counter: 5 ticks at 100 Hz. */
+#define IDLE_MAX_TICKS (UINT16_MAX / TICK_CYCLES)
+
+/* Tickless idle state.  While the PIT runs a one-shot count
+ * started by timer_idle_enter(), IDLE_CYCLES is its length and
+ * IDLE_BASE is how many PIT cycles had passed since the last
+ * counted tick when it started.  IDLE_CARRY is the cycles left
+ * over, less than a tick, after the last stretch: the periodic
+ * tick restarts out of phase by that much. */
+static unsigned idle_cycles;
+static unsigned idle_base;
+static unsigned idle_carry;
+
 /* Number of loops per timer tick.
  * Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Runs the part of the timer interrupt that can wait until
+ * interrupts are back on. */
+static struct softirq expire_softirq;
+
 static intr_handler_func timer_interrupt;
+static softirq_func timer_softirq;
+static bool wake_sleeper(void);
+static heap_less_func wake_less;
+static void wheel_insert(struct timer *);
+static void wheel_run(void);
+static int64_t wheel_next(int64_t limit);
+static void timer_expire(void);
+static int64_t idle_stop(bool expired);
+static thread_func timer_thread;
 static bool too_many_loops(unsigned loops);
 
 static void busy_wait(int64_t loops);
@@ -39,10 +108,31 @@ static void real_time_delay(int64_t num, int32_t denom);
 void
 timer_init(void)
 {
+    int level, slot;
+
+    heap_init(&sleepers, wake_less, NULL);
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        for (slot = 0; slot < WHEEL_SLOTS; slot++) {
+            list_init(&wheel[level][slot]);
+        }
+    }
+    list_init(&expired);
+    sema_init(&expired_sema, 0);
+    softirq_init(&expire_softirq, "timer", timer_softirq, NULL);
+
     pit_configure_channel(0, 2, TIMER_FREQ);
     intr_register_ext(0x20, timer_interrupt, "8254 Timer");
 }
 
+/* Starts the thread that runs timer callbacks.  Timers may be
+ * added earlier, but none will fire until this is called, after
+ * thread_start(). */
+void
+timer_start(void)
+{
+    thread_create("timer", PRI_MAX, timer_thread, NULL);
+}
+
 /* Calibrates loops_per_tick, used to implement brief delays. */
 void
 timer_calibrate(void)
@@ -91,16 +181,105 @@ timer_elapsed(int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
- * be turned on. */
+ * be turned on.
+ *
+ * The thread blocks in the sleepers heap until timer_interrupt()
+ * finds its wake_tick due, so waking the earliest sleeper costs
+ * O(log n) instead of a scan of every sleeping thread. */
 void
 timer_sleep(int64_t ticks)
 {
-    int64_t start = timer_ticks();
+    struct thread *cur = thread_current();
+    enum intr_level old_level;
 
     ASSERT(intr_get_level() == INTR_ON);
-    while (timer_elapsed(start) < ticks) {
-        thread_yield();
+    if (ticks <= 0) {
+        return;
     }
+
+    old_level = intr_disable();
+    cur->wake_tick = timer_ticks() + ticks;
+    heap_push(&sleepers, &cur->sleep_elem);
+    thread_block();
+    intr_set_level(old_level);
+}
+
+/* Initializes T, which must not be pending, to call FUNC with
+ * auxiliary data AUX when it fires. */
+void
+timer_setup(struct timer *t, timer_func *func, void *aux)
+{
+    ASSERT(func != NULL);
+
+    t->func = func;
+    t->aux = aux;
+    t->period = 0;
+    t->pending = false;
+}
+
+/* Arms T to fire DELAY ticks from now and then, if PERIOD is
+ * nonzero, every PERIOD ticks. */
+static void
+timer_arm(struct timer *t, int64_t delay, int64_t period)
+{
+    enum intr_level old_level = intr_disable();
+
+    if (t->pending) {
+        list_remove(&t->elem);
+    }
+    t->expires = ticks + delay;
+    t->period = period;
+    t->pending = true;
+    wheel_insert(t);
+    intr_set_level(old_level);
+}
+
+/* Arms T to fire once, DELAY ticks from now, or at the next tick
+ * if DELAY is not positive.  If T is already pending, it is
+ * rescheduled instead.  May be called from an interrupt
+ * handler. */
+void
+timer_add(struct timer *t, int64_t delay)
+{
+    timer_arm(t, delay, 0);
+}
+
+/* Arms T to fire every PERIOD ticks, starting PERIOD ticks from
+ * now, until it is cancelled.  If the timer thread falls behind,
+ * missed firings are dropped rather than run back to back. */
+void
+timer_add_periodic(struct timer *t, int64_t period)
+{
+    ASSERT(period > 0);
+
+    timer_arm(t, period, period);
+}
+
+/* Disarms T.  Returns true if T was pending, false if it had
+ * already fired or was never added.  Does not wait for a
+ * callback that is already running; a periodic timer may cancel
+ * itself from its own callback.  May be called from an interrupt
+ * handler. */
+bool
+timer_cancel(struct timer *t)
+{
+    enum intr_level old_level = intr_disable();
+    bool was_pending = t->pending;
+
+    if (was_pending) {
+        list_remove(&t->elem);
+        t->pending = false;
+    }
+    t->period = 0;
+    intr_set_level(old_level);
+    return was_pending;
+}
+
+/* Returns true if T is waiting to fire. */
+bool
+timer_pending(const struct timer *t)
+{
+    return t->pending;
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -166,6 +345,101 @@ timer_ndelay(int64_t ns)
     real_time_delay(ns, 1000 * 1000 * 1000);
 }
 
+/* Called by the idle thread, with interrupts off, just before it
+ * halts.  In tickless mode, if no sleeper or timer is due within
+ * the next tick, switches the PIT to a one-shot count that ends
+ * at the next deadline (or as late as the PIT allows), instead of
+ * interrupting every tick in between. */
+void
+timer_idle_enter(void)
+{
+    int64_t next;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (!timer_tickless || idle_cycles != 0) {
+        return;
+    }
+
+    next = ticks + IDLE_MAX_TICKS;
+    if (!heap_empty(&sleepers)) {
+        struct thread *t = heap_entry(heap_min(&sleepers), struct thread,
+                                      sleep_elem);
+
+        if (t->wake_tick < next) {
+            next = t->wake_tick;
+        }
+    }
+    next = wheel_next(next);
+    if (next - ticks < 2) {
+        return;
+    }
+
+    /* The periodic count runs from TICK_CYCLES down to 1, so it
+     * tells how far into the current tick we are.  End the
+     * one-shot exactly on the boundary of tick NEXT. */
+    idle_base = idle_carry + (TICK_CYCLES - pit_read_count(0));
+    idle_cycles = (next - ticks) * TICK_CYCLES - idle_base;
+    pit_start_oneshot(0, idle_cycles);
+}
+
+/* Called with interrupts off when the idle thread is about to
+ * give up the CPU.  If the PIT is running a one-shot count from
+ * timer_idle_enter(), brings the tick count up to date, restarts
+ * the periodic tick, and wakes any sleepers and timers that came
+ * due.  Returns the number of ticks caught up. */
+int64_t
+timer_idle_exit(void)
+{
+    int64_t cnt;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (idle_cycles == 0) {
+        return 0;
+    }
+    cnt = idle_stop(false);
+    timer_expire();
+    return cnt;
+}
+
+/* Ends the one-shot count started by timer_idle_enter(), which
+ * has run out if EXPIRED is true, adds the ticks that passed to
+ * the tick count, restarts the periodic tick, and returns the
+ * number of ticks added. */
+static int64_t
+idle_stop(bool expired)
+{
+    unsigned elapsed = idle_cycles;
+    unsigned total;
+    bool pending = false;
+    int64_t cnt;
+
+    if (!expired) {
+        unsigned left = pit_read_count(0);
+
+        if (left != 0 && left <= idle_cycles) {
+            elapsed = idle_cycles - left;
+        } else {
+            /* The count ran out after interrupts were turned off
+             * and wrapped around to 65535.  Its interrupt is
+             * pending and will count the last tick when it
+             * arrives. */
+            elapsed = idle_cycles + (left != 0 ? UINT16_MAX + 1 - left : 0);
+            pending = true;
+        }
+    }
+
+    total = idle_base + elapsed;
+    cnt = total / TICK_CYCLES - pending;
+    idle_carry = total % TICK_CYCLES;
+    idle_cycles = 0;
+    pit_configure_channel(0, 2, TIMER_FREQ);
+
+    ticks += cnt;
+    return cnt;
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats(void)
@@ -173,12 +447,208 @@ timer_print_stats(void)
     printf("Timer: %" PRId64 " ticks\n", timer_ticks());
 }
 
-/* Timer interrupt handler. */
+/* Timer interrupt handler.  Counts ticks and leaves waking
+ * sleepers and expiring timers to timer_softirq(). */
 static void
 timer_interrupt(struct intr_frame *args UNUSED)
 {
-    ticks++;
-    thread_tick();
+    if (idle_cycles != 0) {
+        /* The one-shot from timer_idle_enter() ran out.  Catch up
+         * on the ticks it covered. */
+        int64_t i, cnt = idle_stop(true);
+
+        for (i = 0; i < cnt; i++) {
+            thread_tick();
+        }
+    } else {
+        ticks++;
+        thread_tick();
+    }
+    softirq_raise(&expire_softirq);
+}
+
+/* Deferred part of the timer interrupt.  Wakes sleepers one at a
+ * time, letting interrupts in between, then runs the wheel. */
+static void
+timer_softirq(void *aux UNUSED)
+{
+    enum intr_level old_level;
+
+    for (;;) {
+        old_level = intr_disable();
+        if (!wake_sleeper()) {
+            break;
+        }
+        intr_set_level(old_level);
+    }
+    wheel_run();
+    intr_set_level(old_level);
+}
+
+/* Wakes sleeping threads and expires timers that are due.
+ * Interrupts must be off. */
+static void
+timer_expire(void)
+{
+    while (wake_sleeper()) {
+        continue;
+    }
+    wheel_run();
+}
+
+/* Wakes the earliest sleeping thread if it is due.  Returns true
+ * if it woke one, false otherwise.  Interrupts must be off. */
+static bool
+wake_sleeper(void)
+{
+    struct thread *t;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (heap_empty(&sleepers)) {
+        return false;
+    }
+    t = heap_entry(heap_min(&sleepers), struct thread, sleep_elem);
+    if (t->wake_tick > ticks) {
+        return false;
+    }
+    heap_pop_min(&sleepers);
+    thread_unblock(t);
+    return true;
+}
+
+/* Returns the slot of wheel LEVEL that covers tick TICK. */
+static inline struct list *
+wheel_slot(int level, int64_t tick)
+{
+    return &wheel[level][(tick >> (WHEEL_BITS * level)) & WHEEL_MASK];
+}
+
+/* Puts pending timer T into the wheel slot for its expiry. */
+static void
+wheel_insert(struct timer *t)
+{
+    int64_t expires = t->expires < wheel_tick ? wheel_tick : t->expires;
+    int level = 0;
+
+    /* Timers beyond the wheel's reach wait in the farthest slot
+     * and are cascaded back into it until they come in range. */
+    if (expires - wheel_tick >= WHEEL_SPAN) {
+        expires = wheel_tick + WHEEL_SPAN - 1;
+    }
+    while (expires - wheel_tick >= (int64_t)1 << (WHEEL_BITS * (level + 1))) {
+        level++;
+    }
+    list_push_back(wheel_slot(level, expires), &t->elem);
+}
+
+/* Moves the timers in the current slot of LEVEL back into the
+ * wheel, where they land in lower levels. */
+static void
+wheel_cascade(int level)
+{
+    struct list *slot = wheel_slot(level, wheel_tick);
+    struct list timers;
+
+    list_init(&timers);
+    list_splice(list_end(&timers), list_begin(slot), list_end(slot));
+    while (!list_empty(&timers)) {
+        wheel_insert(list_entry(list_pop_front(&timers), struct timer, elem));
+    }
+}
+
+/* Processes every tick up to the current one, moving expired
+ * timers to the expiry list, and wakes the timer thread if there
+ * is anything for it to do. */
+static void
+wheel_run(void)
+{
+    bool was_empty = list_empty(&expired);
+
+    while (wheel_tick <= ticks) {
+        struct list *slot = wheel_slot(0, wheel_tick);
+        int level;
+
+        /* Cascade level L whenever level L - 1 wraps around. */
+        for (level = 1; level < WHEEL_LEVELS; level++) {
+            if (wheel_slot(level - 1, wheel_tick) != &wheel[level - 1][0]) {
+                break;
+            }
+            wheel_cascade(level);
+        }
+        if (!list_empty(slot)) {
+            list_splice(list_end(&expired), list_begin(slot), list_end(slot));
+        }
+        wheel_tick++;
+    }
+
+    if (was_empty && !list_empty(&expired)) {
+        sema_up(&expired_sema);
+        if (intr_context() || softirq_context()) {
+            intr_yield_on_return();
+        }
+    }
+}
+
+/* Returns the first tick before LIMIT at which the wheel may have
+ * work to do, or LIMIT if there is none.  Ticks at which a level
+ * wraps around count as work, because their cascades may bring
+ * timers due at that very tick. */
+static int64_t
+wheel_next(int64_t limit)
+{
+    int64_t t;
+
+    for (t = wheel_tick; t < limit; t++) {
+        if ((t & WHEEL_MASK) == 0 || !list_empty(wheel_slot(0, t))) {
+            return t;
+        }
+    }
+    return limit;
+}
+
+/* Timer thread.  Runs the callbacks of expired timers, re-arming
+ * periodic timers first so that a callback may cancel its own
+ * timer or free it. */
+static void
+timer_thread(void *aux UNUSED)
+{
+    for (;;) {
+        enum intr_level old_level;
+
+        sema_down(&expired_sema);
+        old_level = intr_disable();
+        while (!list_empty(&expired)) {
+            struct timer *t =
+                list_entry(list_pop_front(&expired), struct timer, elem);
+
+            t->pending = false;
+            if (t->period > 0) {
+                t->expires += t->period;
+                if (t->expires <= ticks) {
+                    t->expires = ticks + t->period;
+                }
+                t->pending = true;
+                wheel_insert(t);
+            }
+
+            intr_set_level(old_level);
+            t->func(t, t->aux);
+            old_level = intr_disable();
+        }
+        intr_set_level(old_level);
+    }
+}
+
+/* Orders sleeping threads by wake_tick. */
+static bool
+wake_less(const struct heap_elem *a_, const struct heap_elem *b_,
+          void *aux UNUSED)
+{
+    const struct thread *a = heap_entry(a_, struct thread, sleep_elem);
+    const struct thread *b = heap_entry(b_, struct thread, sleep_elem);
+
+    return a->wake_tick < b->wake_tick;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -1,13 +1,38 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* Stop the periodic tick while idle?  See timer_idle_enter(). */
+extern bool timer_tickless;
+
+struct timer;
+
+/* Timer callback, given the timer and its auxiliary data.  Runs
+ * in the timer thread with interrupts on, so it may take locks,
+ * but every other timer waits while it runs. */
+typedef void timer_func(struct timer *, void *aux);
+
+/* A kernel timer.  The caller owns the storage, which must stay
+ * valid while the timer is pending; the members are private to
+ * timer.c. */
+struct timer {
+    struct list_elem elem;    /* Element in a wheel slot or expiry list. */
+    int64_t          expires; /* Tick at which the timer fires. */
+    int64_t          period;  /* Interval between firings, or 0. */
+    timer_func      *func;    /* Callback. */
+    void            *aux;     /* Auxiliary data for `func'. */
+    bool             pending; /* Waiting to fire? */
+};
+
 void timer_init(void);
+void timer_start(void);
 void timer_calibrate(void);
 int64_t timer_ticks(void);
 int64_t timer_elapsed(int64_t);
@@ -18,6 +43,17 @@ void timer_msleep(int64_t milliseconds);
 void timer_usleep(int64_t microseconds);
 void timer_nsleep(int64_t nanoseconds);
 
+/* Timeouts. */
+void timer_setup(struct timer *, timer_func *, void *aux);
+void timer_add(struct timer *, int64_t ticks);
+void timer_add_periodic(struct timer *, int64_t period);
+bool timer_cancel(struct timer *);
+bool timer_pending(const struct timer *);
+
+/* Tickless idle. */
+void timer_idle_enter(void);
+int64_t timer_idle_exit(void);
+
 /* Busy waits. */
 void timer_mdelay(int64_t milliseconds);
 void timer_udelay(int64_t microseconds);
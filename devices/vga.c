@@ -26,6 +26,11 @@ static size_t cx, cy;
  * The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t(*fb)[COL_CNT][2];
 
+/* Most characters vga_putbuf() draws per interrupts-off section. */
+#define PUTBUF_CHUNK 64
+
+static void render(int c, enum intr_level);
+
 static void clear_row(size_t y);
 
 static void cls(void);
@@ -60,7 +65,42 @@ vga_putc(int c)
     enum intr_level old_level = intr_disable();
 
     init();
+    render(c, old_level);
+
+    /* Update cursor position. */
+    move_cursor();
+
+    intr_set_level(old_level);
+}
+
+/* Writes the CNT characters in BUF to the VGA text display, as
+ * vga_putc() would, but moves the hardware cursor only once per
+ * PUTBUF_CHUNK characters.  Interrupts are turned off for one
+ * chunk at a time, so a long write does not hold off the timer. */
+void
+vga_putbuf(const char *buf, size_t cnt)
+{
+    while (cnt > 0) {
+        size_t n = cnt < PUTBUF_CHUNK ? cnt : PUTBUF_CHUNK;
+        enum intr_level old_level = intr_disable();
+
+        init();
+        cnt -= n;
+        while (n-- > 0) {
+            render(*buf++, old_level);
+        }
+        move_cursor();
 
+        intr_set_level(old_level);
+    }
+}
+
+/* Draws C at the cursor, or carries out the control character
+ * C, without moving the hardware cursor.  Interrupts must be off;
+ * OLD_LEVEL is the level to restore while beeping. */
+static void
+render(int c, enum intr_level old_level)
+{
     switch (c) {
     case '\n':
         newline();
@@ -101,11 +141,6 @@ vga_putc(int c)
         }
         break;
     }
-
-    /* Update cursor position. */
-    move_cursor();
-
-    intr_set_level(old_level);
 }
 
 /* Clears the screen and moves the cursor to the upper left. */
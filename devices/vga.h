@@ -1,6 +1,9 @@
 #ifndef DEVICES_VGA_H
 #define DEVICES_VGA_H
 
+#include <stddef.h>
+
 void vga_putc(int);
+void vga_putbuf(const char *, size_t cnt);
 
 #endif /* devices/vga.h */
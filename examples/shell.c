@@ -52,14 +52,28 @@ static void
 read_line (char line[], size_t size)
 {
   char *pos = line;
+  char buf[64];
+  int cnt = 0, i = 0;
+
   for (;;)
     {
       char c;
-      read (STDIN_FILENO, &c, 1);
+
+      /* The console returns at most one line per read, so
+         nothing after the new-line is ever consumed here. */
+      if (i >= cnt)
+        {
+          cnt = read (STDIN_FILENO, buf, sizeof buf);
+          i = 0;
+          if (cnt <= 0)
+            continue;
+        }
+      c = buf[i++];
 
       switch (c)
         {
         case '\r':
+        case '\n':
           *pos = '\0';
           putchar ('\n');
           return;
@@ -6,10 +6,16 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Sectors per page, the most that one bounced transfer of a user
+ * buffer moves. */
+#define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
 /* Returns the number of sectors to allocate for an inode SIZE
  * bytes long. */
 static inline size_t
@@ -180,6 +186,7 @@ inode_read_at(struct inode *inode, void *buffer_, off_t size, off_t offset)
     uint8_t *buffer = buffer_;
     off_t bytes_read = 0;
     uint8_t *bounce = NULL;
+    uint8_t *page = NULL;
 
     while (size > 0) {
         /* Disk sector to read, starting byte offset within sector. */
@@ -198,8 +205,32 @@ inode_read_at(struct inode *inode, void *buffer_, off_t size, off_t offset)
         }
 
         if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
-            /* Read full sector directly into caller's buffer. */
-            block_read(fs_device, sector_idx, buffer + bytes_read);
+            /* Read full sectors directly into caller's buffer.  A
+             * file's sectors are contiguous, so one request can
+             * cover all of the full sectors that remain.  The
+             * device's I/O thread does the transfer and cannot see
+             * user memory, so a user buffer gets a page at a time
+             * through a kernel page instead. */
+            off_t full = (size < inode_left ? size : inode_left)
+                         / BLOCK_SECTOR_SIZE;
+
+            if (is_kernel_vaddr(buffer + bytes_read)) {
+                block_read_multiple(fs_device, sector_idx, full,
+                                    buffer + bytes_read);
+            } else {
+                if (full > PAGE_SECTORS) {
+                    full = PAGE_SECTORS;
+                }
+                if (page == NULL) {
+                    page = palloc_get_page(0);
+                    if (page == NULL) {
+                        break;
+                    }
+                }
+                block_read_multiple(fs_device, sector_idx, full, page);
+                memcpy(buffer + bytes_read, page, full * BLOCK_SECTOR_SIZE);
+            }
+            chunk_size = full * BLOCK_SECTOR_SIZE;
         } else {
             /* Read sector into bounce buffer, then partially copy
              * into caller's buffer. */
@@ -219,6 +250,9 @@ inode_read_at(struct inode *inode, void *buffer_, off_t size, off_t offset)
         bytes_read += chunk_size;
     }
     free(bounce);
+    if (page != NULL) {
+        palloc_free_page(page);
+    }
 
     return bytes_read;
 }
@@ -235,6 +269,7 @@ inode_write_at(struct inode *inode, const void *buffer_, off_t size,
     const uint8_t *buffer = buffer_;
     off_t bytes_written = 0;
     uint8_t *bounce = NULL;
+    uint8_t *page = NULL;
 
     if (inode->deny_write_cnt) {
         return 0;
@@ -257,8 +292,30 @@ inode_write_at(struct inode *inode, const void *buffer_, off_t size,
         }
 
         if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
-            /* Write full sector directly to disk. */
-            block_write(fs_device, sector_idx, buffer + bytes_written);
+            /* Write full sectors directly to disk, all at once, or
+             * a page at a time from a user buffer, as in
+             * inode_read_at(). */
+            off_t full = (size < inode_left ? size : inode_left)
+                         / BLOCK_SECTOR_SIZE;
+
+            if (is_kernel_vaddr(buffer + bytes_written)) {
+                block_write_multiple(fs_device, sector_idx, full,
+                                     buffer + bytes_written);
+            } else {
+                if (full > PAGE_SECTORS) {
+                    full = PAGE_SECTORS;
+                }
+                if (page == NULL) {
+                    page = palloc_get_page(0);
+                    if (page == NULL) {
+                        break;
+                    }
+                }
+                memcpy(page, buffer + bytes_written,
+                       full * BLOCK_SECTOR_SIZE);
+                block_write_multiple(fs_device, sector_idx, full, page);
+            }
+            chunk_size = full * BLOCK_SECTOR_SIZE;
         } else {
             /* We need a bounce buffer. */
             if (bounce == NULL) {
@@ -286,6 +343,9 @@ inode_write_at(struct inode *inode, const void *buffer_, off_t size,
         bytes_written += chunk_size;
     }
     free(bounce);
+    if (page != NULL) {
+        palloc_free_page(page);
+    }
 
     return bytes_written;
 }
@@ -28,6 +28,7 @@ typedef unsigned long elem_type;
 struct bitmap {
     size_t     bit_cnt; /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    size_t     hint;    /* Where the next next-fit scan starts. */
 };
 
 /* Returns the index of the element that contains the bit
@@ -53,6 +54,14 @@ elem_cnt(size_t bit_cnt)
     return DIV_ROUND_UP(bit_cnt, ELEM_BITS);
 }
 
+/* Returns an elem_type with the bits for BIT_IDX and everything
+ * above it in the same element turned on. */
+static inline elem_type
+high_mask(size_t bit_idx)
+{
+    return (elem_type) - 1 << (bit_idx % ELEM_BITS);
+}
+
 /* Returns the number of bytes required for BIT_CNT bits. */
 static inline size_t
 byte_cnt(size_t bit_cnt)
@@ -83,6 +92,7 @@ bitmap_create(size_t bit_cnt)
 
     if (b != NULL) {
         b->bit_cnt = bit_cnt;
+        b->hint = 0;
         b->bits = malloc(byte_cnt(bit_cnt));
         if (b->bits != NULL || bit_cnt == 0) {
             bitmap_set_all(b, false);
@@ -104,6 +114,7 @@ bitmap_create_in_buf(size_t bit_cnt, void *block, size_t block_size UNUSED)
     ASSERT(block_size >= bitmap_buf_size(bit_cnt));
 
     b->bit_cnt = bit_cnt;
+    b->hint = 0;
     b->bits = (elem_type *)(b + 1);
     bitmap_set_all(b, false);
     return b;
@@ -213,18 +224,38 @@ bitmap_set_all(struct bitmap *b, bool value)
     bitmap_set_multiple(b, 0, bitmap_size(b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Atomically sets the bits in MASK within element IDX of B to
+ * VALUE. */
+static inline void
+set_elem_bits(struct bitmap *b, size_t idx, elem_type mask, bool value)
+{
+    if (value) {
+        asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+    } else {
+        asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+    }
+}
+
+/* Sets the CNT bits starting at START in B to VALUE.
+ * Each element is updated atomically, a whole element at a time. */
 void
 bitmap_set_multiple(struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-    size_t i;
+    size_t end = start + cnt;
 
     ASSERT(b != NULL);
     ASSERT(start <= b->bit_cnt);
     ASSERT(start + cnt <= b->bit_cnt);
 
-    for (i = 0; i < cnt; i++) {
-        bitmap_set(b, start + i, value);
+    while (start < end) {
+        size_t idx = elem_idx(start);
+        elem_type mask = high_mask(start);
+
+        if (idx == elem_idx(end - 1)) {
+            mask &= (elem_type) - 1 >> (ELEM_BITS - 1 - (end - 1) % ELEM_BITS);
+        }
+        set_elem_bits(b, idx, mask, value);
+        start = (idx + 1) * ELEM_BITS;
     }
 }
 
@@ -248,23 +279,45 @@ bitmap_count(const struct bitmap *b, size_t start, size_t cnt, bool value)
     return value_cnt;
 }
 
+/* Returns the index of the first bit in B at or after START that
+ * is set to VALUE, or B's size if there is none.  Works a whole
+ * element at a time, skipping elements with no bit set to VALUE
+ * and using a bit-scan instruction to find the bit within an
+ * element. */
+static size_t
+find_next(const struct bitmap *b, size_t start, bool value)
+{
+    size_t idx = elem_idx(start);
+    size_t last_idx = elem_cnt(b->bit_cnt);
+    elem_type flip = value ? 0 : (elem_type) - 1;
+    elem_type word;
+
+    if (start >= b->bit_cnt) {
+        return b->bit_cnt;
+    }
+
+    word = (b->bits[idx] ^ flip) & high_mask(start);
+    while (word == 0) {
+        if (++idx == last_idx) {
+            return b->bit_cnt;
+        }
+        word = b->bits[idx] ^ flip;
+    }
+
+    start = idx * ELEM_BITS + __builtin_ctzl(word);
+    return start < b->bit_cnt ? start : b->bit_cnt;
+}
+
 /* Returns true if any bits in B between START and START + CNT,
  * exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains(const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-    size_t i;
-
     ASSERT(b != NULL);
     ASSERT(start <= b->bit_cnt);
     ASSERT(start + cnt <= b->bit_cnt);
 
-    for (i = 0; i < cnt; i++) {
-        if (bitmap_test(b, start + i) == value) {
-            return true;
-        }
-    }
-    return false;
+    return cnt > 0 && find_next(b, start, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -296,20 +349,35 @@ bitmap_all(const struct bitmap *b, size_t start, size_t cnt)
 /* Finds and returns the starting index of the first group of CNT
  * consecutive bits in B at or after START that are all set to
  * VALUE.
- * If there is no such group, returns BITMAP_ERROR. */
+ * If there is no such group, returns BITMAP_ERROR.
+ * Jumps from run to run of VALUE bits rather than testing every
+ * candidate start, so the cost is proportional to the number of
+ * elements and runs examined, not to the number of bits. */
 size_t
 bitmap_scan(const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
     ASSERT(b != NULL);
     ASSERT(start <= b->bit_cnt);
 
+    if (cnt == 0) {
+        return start;
+    }
     if (cnt <= b->bit_cnt) {
         size_t last = b->bit_cnt - cnt;
-        size_t i;
-        for (i = start; i <= last; i++) {
-            if (!bitmap_contains(b, i, cnt, !value)) {
+        size_t i = start;
+
+        for (;;) {
+            size_t run_end;
+
+            i = find_next(b, i, value);
+            if (i > last) {
+                break;
+            }
+            run_end = find_next(b, i, !value);
+            if (run_end - i >= cnt) {
                 return i;
             }
+            i = run_end;
         }
     }
     return BITMAP_ERROR;
@@ -333,6 +401,32 @@ bitmap_scan_and_flip(struct bitmap *b, size_t start, size_t cnt, bool value)
     return idx;
 }
 
+/* Like bitmap_scan_and_flip(), but searches next-fit: starts
+ * where the previous call to this function left off and wraps
+ * around to the beginning of B, instead of always starting at
+ * bit 0.  This keeps repeated small allocations from rescanning
+ * the densely used low end of B. */
+size_t
+bitmap_scan_and_flip_next(struct bitmap *b, size_t cnt, bool value)
+{
+    size_t idx;
+
+    ASSERT(b != NULL);
+
+    if (b->hint > b->bit_cnt) {
+        b->hint = 0;
+    }
+    idx = bitmap_scan(b, b->hint, cnt, value);
+    if (idx == BITMAP_ERROR && b->hint != 0) {
+        idx = bitmap_scan(b, 0, cnt, value);
+    }
+    if (idx != BITMAP_ERROR) {
+        bitmap_set_multiple(b, idx, cnt, !value);
+        b->hint = idx + cnt;
+    }
+    return idx;
+}
+
 /* File input and output. */
 
 #ifdef FILESYS
@@ -1,6 +1,7 @@
 #include <console.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "devices/serial.h"
 #include "devices/vga.h"
@@ -12,6 +13,16 @@ static void vprintf_helper(char, void *);
 
 static void putchar_have_lock(uint8_t c);
 
+static void putbuf_have_lock(const char *, size_t);
+
+/* Output collected by vprintf() so that it reaches the devices
+ * in batches rather than a character at a time. */
+struct vprintf_buffer {
+    char   buf[64]; /* Characters not yet written. */
+    size_t cnt;     /* Number of characters in BUF. */
+    int    char_cnt; /* Total number of characters output. */
+};
+
 /* The console lock.
  * Both the vga and serial layers do their own locking, so it's
  * safe to call them at any time.
@@ -127,13 +138,17 @@ console_locked_by_current_thread(void)
 int
 vprintf(const char *format, va_list args)
 {
-    int char_cnt = 0;
+    struct vprintf_buffer b;
+
+    b.cnt = 0;
+    b.char_cnt = 0;
 
     acquire_console();
-    __vprintf(format, args, vprintf_helper, &char_cnt);
+    __vprintf(format, args, vprintf_helper, &b);
+    putbuf_have_lock(b.buf, b.cnt);
     release_console();
 
-    return char_cnt;
+    return b.char_cnt;
 }
 
 /* Writes string S to the console, followed by a new-line
@@ -142,9 +157,7 @@ int
 puts(const char *s)
 {
     acquire_console();
-    while (*s != '\0') {
-        putchar_have_lock(*s++);
-    }
+    putbuf_have_lock(s, strlen(s));
     putchar_have_lock('\n');
     release_console();
 
@@ -156,9 +169,7 @@ void
 putbuf(const char *buffer, size_t n)
 {
     acquire_console();
-    while (n-- > 0) {
-        putchar_have_lock(*buffer++);
-    }
+    putbuf_have_lock(buffer, n);
     release_console();
 }
 
@@ -175,12 +186,29 @@ putchar(int c)
 
 /* Helper function for vprintf(). */
 static void
-vprintf_helper(char c, void *char_cnt_)
+vprintf_helper(char c, void *b_)
 {
-    int *char_cnt = char_cnt_;
+    struct vprintf_buffer *b = b_;
 
-    (*char_cnt)++;
-    putchar_have_lock(c);
+    b->char_cnt++;
+    b->buf[b->cnt++] = c;
+    if (b->cnt >= sizeof b->buf) {
+        putbuf_have_lock(b->buf, b->cnt);
+        b->cnt = 0;
+    }
+}
+
+/* Writes the N characters in BUFFER to the vga display and serial
+ * port, handing each device the whole buffer at once.
+ * The caller has already acquired the console lock if
+ * appropriate. */
+static void
+putbuf_have_lock(const char *buffer, size_t n)
+{
+    ASSERT(console_locked_by_current_thread());
+    write_cnt += n;
+    serial_putbuf((const uint8_t *)buffer, n);
+    vga_putbuf(buffer, n);
 }
 
 /* Writes C to the vga display and serial port.
@@ -0,0 +1,189 @@
+/* Pairing heap.
+ *
+ * The algorithms are those of [Fredman86], with the two-pass
+ * variant of pairing on removal of the root.  See heap.h for
+ * basic information. */
+
+#include "heap.h"
+#include "../debug.h"
+
+static struct heap_elem *meld(struct heap *, struct heap_elem *,
+                              struct heap_elem *);
+static struct heap_elem *merge_pairs(struct heap *, struct heap_elem *);
+static void cut(struct heap_elem *);
+
+/* Initializes H as an empty heap that orders its elements with
+ * LESS given auxiliary data AUX. */
+void
+heap_init(struct heap *h, heap_less_func *less, void *aux)
+{
+    ASSERT(h != NULL);
+    ASSERT(less != NULL);
+
+    h->root = NULL;
+    h->size = 0;
+    h->less = less;
+    h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+heap_push(struct heap *h, struct heap_elem *e)
+{
+    ASSERT(e != NULL);
+
+    e->child = e->next = e->prev = NULL;
+    h->root = h->root != NULL ? meld(h, h->root, e) : e;
+    h->size++;
+}
+
+/* Removes the least element from H and returns it.  H must not
+ * be empty.  If several elements are least, which one is
+ * returned is unspecified. */
+struct heap_elem *
+heap_pop_min(struct heap *h)
+{
+    struct heap_elem *min = h->root;
+
+    ASSERT(min != NULL);
+
+    h->root = merge_pairs(h, min->child);
+    h->size--;
+    return min;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove(struct heap *h, struct heap_elem *e)
+{
+    struct heap_elem *sub;
+
+    ASSERT(h->size > 0);
+
+    if (e == h->root) {
+        heap_pop_min(h);
+        return;
+    }
+
+    /* Cut out E's subtree, then put E's children back. */
+    cut(e);
+    sub = merge_pairs(h, e->child);
+    if (sub != NULL) {
+        h->root = meld(h, h->root, sub);
+    }
+    h->size--;
+}
+
+/* Restores H's order after the key of E, which must be in H, has
+ * been lowered.  Raising a key this way is not allowed; remove
+ * the element and push it again instead. */
+void
+heap_decrease(struct heap *h, struct heap_elem *e)
+{
+    if (e != h->root) {
+        /* E is still no greater than its children, so its whole
+         * subtree can move. */
+        cut(e);
+        h->root = meld(h, h->root, e);
+    }
+}
+
+/* Returns the least element in H, or a null pointer if H is
+ * empty. */
+struct heap_elem *
+heap_min(struct heap *h)
+{
+    return h->root;
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size(struct heap *h)
+{
+    return h->size;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+heap_empty(struct heap *h)
+{
+    return h->root == NULL;
+}
+
+/* Links trees A and B, whose roots have no siblings or parents,
+ * into one tree by making the greater root the first child of
+ * the lesser, and returns the new root. */
+static struct heap_elem *
+meld(struct heap *h, struct heap_elem *a, struct heap_elem *b)
+{
+    if (h->less(b, a, h->aux)) {
+        struct heap_elem *t = a;
+        a = b;
+        b = t;
+    }
+
+    b->prev = a;
+    b->next = a->child;
+    if (a->child != NULL) {
+        a->child->prev = b;
+    }
+    a->child = b;
+    return a;
+}
+
+/* Links the sibling list starting at FIRST into a single tree
+ * and returns its root, or a null pointer if FIRST is null.
+ * Pairs siblings left to right, then melds the pairs right to
+ * left, which is what keeps the amortized cost logarithmic. */
+static struct heap_elem *
+merge_pairs(struct heap *h, struct heap_elem *first)
+{
+    struct heap_elem *pairs = NULL;
+    struct heap_elem *root = NULL;
+
+    /* First pass: meld adjacent siblings, pushing each result on
+     * PAIRS, which thus ends up in reverse order. */
+    while (first != NULL) {
+        struct heap_elem *a = first;
+        struct heap_elem *b = a->next;
+
+        a->next = a->prev = NULL;
+        if (b != NULL) {
+            first = b->next;
+            b->next = b->prev = NULL;
+            a = meld(h, a, b);
+        } else {
+            first = NULL;
+        }
+        a->next = pairs;
+        pairs = a;
+    }
+
+    /* Second pass: meld the pairs into one tree. */
+    while (pairs != NULL) {
+        struct heap_elem *next = pairs->next;
+
+        pairs->next = NULL;
+        root = root != NULL ? meld(h, root, pairs) : pairs;
+        pairs = next;
+    }
+    return root;
+}
+
+/* Detaches the subtree rooted at E, which must not be the root
+ * of its heap, from its parent and siblings. */
+static void
+cut(struct heap_elem *e)
+{
+    ASSERT(e->prev != NULL);
+
+    if (e->prev->child == e) {
+        e->prev->child = e->next;
+    } else {
+        e->prev->next = e->next;
+    }
+    if (e->next != NULL) {
+        e->next->prev = e->prev;
+    }
+    e->next = e->prev = NULL;
+}
@@ -0,0 +1,74 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Pairing heap.
+ *
+ * A priority queue for when list_insert_ordered() is too slow.
+ * heap_push() and heap_min() take O(1) time, and heap_pop_min()
+ * and heap_remove() take O(log n) amortized time.  Lowering an
+ * element's key in place and then calling heap_decrease() moves
+ * it up in O(1) amortized time (the bound is in fact a little
+ * worse, but small in practice), which suits deadlines that only
+ * move earlier and priorities that only rise.
+ *
+ * Like lists, the heap is intrusive: each structure that can be
+ * in a heap embeds a struct heap_elem member, and heap_entry()
+ * converts from it back to the structure.  Keys are compared by
+ * a less function supplied at initialization.  Equal elements
+ * come out in no particular order.
+ *
+ * Internally, the heap is a tree in which each element is no
+ * greater than any of its children.  Each element points to its
+ * first child and to its next sibling, and to its previous
+ * sibling or, for a first child, its parent, so that any element
+ * can be cut out of the tree without a search. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem {
+    struct heap_elem *child; /* First child. */
+    struct heap_elem *next;  /* Next sibling. */
+    struct heap_elem *prev;  /* Previous sibling, or parent if first. */
+};
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+ * the structure that HEAP_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)    \
+    ((STRUCT *)((uint8_t *)&(HEAP_ELEM)->child   \
+                - offsetof(STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void                   *aux);
+
+/* Pairing heap. */
+struct heap {
+    struct heap_elem *root; /* Least element, or null if empty. */
+    size_t            size; /* Number of elements. */
+    heap_less_func   *less; /* Comparison function. */
+    void             *aux;  /* Auxiliary data for `less'. */
+};
+
+/* Initialization. */
+void heap_init(struct heap *, heap_less_func *, void *aux);
+
+/* Insertion and removal. */
+void heap_push(struct heap *, struct heap_elem *);
+struct heap_elem *heap_pop_min(struct heap *);
+void heap_remove(struct heap *, struct heap_elem *);
+void heap_decrease(struct heap *, struct heap_elem *);
+
+/* Information. */
+struct heap_elem *heap_min(struct heap *);
+size_t heap_size(struct heap *);
+bool heap_empty(struct heap *);
+
+#endif /* lib/kernel/heap.h */
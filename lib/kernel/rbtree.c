@@ -0,0 +1,490 @@
+/* Red-black tree.
+ *
+ * The algorithms are those of [CLRS] chapter 13, with null
+ * pointers in place of the sentinel leaf.  See rbtree.h for
+ * basic information. */
+
+#include "rbtree.h"
+#include "../debug.h"
+
+static void insert(struct rbtree *, struct rb_elem *, bool unique,
+                   struct rb_elem **equal);
+static void insert_fixup(struct rbtree *, struct rb_elem *);
+static void remove_fixup(struct rbtree *, struct rb_elem *, struct rb_elem *);
+static void rotate_left(struct rbtree *, struct rb_elem *);
+static void rotate_right(struct rbtree *, struct rb_elem *);
+static void augment_path(struct rbtree *, struct rb_elem *);
+
+/* Initializes T as an empty tree that orders its elements with
+ * LESS and keeps their augmented data up to date with AUGMENT,
+ * which may be null, given auxiliary data AUX. */
+void
+rb_init(struct rbtree *t, rb_less_func *less, rb_augment_func *augment,
+        void *aux)
+{
+    ASSERT(t != NULL);
+    ASSERT(less != NULL);
+
+    t->root = NULL;
+    t->size = 0;
+    t->less = less;
+    t->augment = augment;
+    t->aux = aux;
+}
+
+/* Inserts NEW into T and returns a null pointer, if no equal
+ * element is already in the tree.  If an equal element is
+ * already in the tree, returns it without inserting NEW. */
+struct rb_elem *
+rb_insert(struct rbtree *t, struct rb_elem *new)
+{
+    struct rb_elem *equal;
+
+    insert(t, new, true, &equal);
+    return equal;
+}
+
+/* Inserts NEW into T, even if equal elements are already in the
+ * tree.  NEW goes after all of them in order. */
+void
+rb_insert_multi(struct rbtree *t, struct rb_elem *new)
+{
+    insert(t, new, false, NULL);
+}
+
+/* Replaces child OLD of OLD's parent, or T's root if OLD is the
+ * root, by NEW. */
+static void
+replace_child(struct rbtree *t, struct rb_elem *old, struct rb_elem *new)
+{
+    struct rb_elem *parent = old->parent;
+
+    if (parent == NULL) {
+        t->root = new;
+    } else if (parent->left == old) {
+        parent->left = new;
+    } else {
+        parent->right = new;
+    }
+}
+
+/* Returns the leftmost element in the subtree rooted at E. */
+static struct rb_elem *
+subtree_first(struct rb_elem *e)
+{
+    while (e->left != NULL) {
+        e = e->left;
+    }
+    return e;
+}
+
+/* Returns the rightmost element in the subtree rooted at E. */
+static struct rb_elem *
+subtree_last(struct rb_elem *e)
+{
+    while (e->right != NULL) {
+        e = e->right;
+    }
+    return e;
+}
+
+/* Returns true if E is red.  Null leaves are black. */
+static inline bool
+is_red(const struct rb_elem *e)
+{
+    return e != NULL && e->red;
+}
+
+/* Removes E, which must be in T, from T. */
+void
+rb_remove(struct rbtree *t, struct rb_elem *e)
+{
+    struct rb_elem *child, *parent;
+    bool was_red;
+
+    ASSERT(t->size > 0);
+
+    if (e->left != NULL && e->right != NULL) {
+        /* E has two children.  Its successor Y, which has no left
+         * child, takes E's place in the tree, and Y's right child
+         * takes Y's old place. */
+        struct rb_elem *y = subtree_first(e->right);
+
+        child = y->right;
+        parent = y->parent;
+        was_red = y->red;
+        if (parent == e) {
+            parent = y;
+        } else {
+            if (child != NULL) {
+                child->parent = parent;
+            }
+            parent->left = child;
+            y->right = e->right;
+            e->right->parent = y;
+        }
+        y->left = e->left;
+        e->left->parent = y;
+        y->parent = e->parent;
+        replace_child(t, e, y);
+        y->red = e->red;
+    } else {
+        /* E has at most one child, which takes its place. */
+        child = e->left != NULL ? e->left : e->right;
+        parent = e->parent;
+        was_red = e->red;
+        if (child != NULL) {
+            child->parent = parent;
+        }
+        replace_child(t, e, child);
+    }
+    t->size--;
+
+    augment_path(t, parent);
+    if (!was_red) {
+        remove_fixup(t, child, parent);
+    }
+}
+
+/* Searches T for an element equal to KEY and returns it, or a
+ * null pointer if there is none.  If several elements are equal
+ * to KEY, returns the first of them. */
+struct rb_elem *
+rb_find(struct rbtree *t, const struct rb_elem *key)
+{
+    struct rb_elem *e = rb_lower_bound(t, key);
+
+    return e != NULL && !t->less(key, e, t->aux) ? e : NULL;
+}
+
+/* Returns the first element in T that is not less than KEY, or a
+ * null pointer if every element is less than KEY. */
+struct rb_elem *
+rb_lower_bound(struct rbtree *t, const struct rb_elem *key)
+{
+    struct rb_elem *e = t->root;
+    struct rb_elem *bound = NULL;
+
+    while (e != NULL) {
+        if (!t->less(e, key, t->aux)) {
+            bound = e;
+            e = e->left;
+        } else {
+            e = e->right;
+        }
+    }
+    return bound;
+}
+
+/* Returns the first element in T that is greater than KEY, or a
+ * null pointer if no element is greater than KEY. */
+struct rb_elem *
+rb_upper_bound(struct rbtree *t, const struct rb_elem *key)
+{
+    struct rb_elem *e = t->root;
+    struct rb_elem *bound = NULL;
+
+    while (e != NULL) {
+        if (t->less(key, e, t->aux)) {
+            bound = e;
+            e = e->left;
+        } else {
+            e = e->right;
+        }
+    }
+    return bound;
+}
+
+/* Returns the least element in T, or a null pointer if T is
+ * empty. */
+struct rb_elem *
+rb_first(struct rbtree *t)
+{
+    return t->root != NULL ? subtree_first(t->root) : NULL;
+}
+
+/* Returns the greatest element in T, or a null pointer if T is
+ * empty. */
+struct rb_elem *
+rb_last(struct rbtree *t)
+{
+    return t->root != NULL ? subtree_last(t->root) : NULL;
+}
+
+/* Returns the element after E in its tree, or a null pointer if
+ * E is the last element.
+ *
+ * Iteration idiom:
+ *
+ *    struct rb_elem *e;
+ *
+ *    for (e = rb_first (&tree); e != NULL; e = rb_next (e))
+ *      {
+ *        struct foo *f = rb_entry (e, struct foo, elem);
+ *        ...do something with f...
+ *      }
+ */
+struct rb_elem *
+rb_next(struct rb_elem *e)
+{
+    ASSERT(e != NULL);
+
+    if (e->right != NULL) {
+        return subtree_first(e->right);
+    }
+    while (e->parent != NULL && e == e->parent->right) {
+        e = e->parent;
+    }
+    return e->parent;
+}
+
+/* Returns the element before E in its tree, or a null pointer if
+ * E is the first element. */
+struct rb_elem *
+rb_prev(struct rb_elem *e)
+{
+    ASSERT(e != NULL);
+
+    if (e->left != NULL) {
+        return subtree_last(e->left);
+    }
+    while (e->parent != NULL && e == e->parent->left) {
+        e = e->parent;
+    }
+    return e->parent;
+}
+
+/* Returns T's root element, or a null pointer if T is empty, for
+ * searches that walk the tree themselves. */
+struct rb_elem *
+rb_root(struct rbtree *t)
+{
+    return t->root;
+}
+
+/* Returns the number of elements in T. */
+size_t
+rb_size(struct rbtree *t)
+{
+    return t->size;
+}
+
+/* Returns true if T contains no elements, false otherwise. */
+bool
+rb_empty(struct rbtree *t)
+{
+    return t->root == NULL;
+}
+
+/* Inserts NEW into T.  If UNIQUE, and an element equal to NEW
+ * is already in T, stores it in *EQUAL and does not insert NEW;
+ * otherwise stores a null pointer in *EQUAL, if EQUAL is
+ * nonnull. */
+static void
+insert(struct rbtree *t, struct rb_elem *new, bool unique,
+       struct rb_elem **equal)
+{
+    struct rb_elem **link = &t->root;
+    struct rb_elem *parent = NULL;
+
+    ASSERT(new != NULL);
+
+    while (*link != NULL) {
+        parent = *link;
+        if (t->less(new, parent, t->aux)) {
+            link = &parent->left;
+        } else if (unique && !t->less(parent, new, t->aux)) {
+            *equal = parent;
+            return;
+        } else {
+            link = &parent->right;
+        }
+    }
+    if (equal != NULL) {
+        *equal = NULL;
+    }
+
+    new->parent = parent;
+    new->left = new->right = NULL;
+    new->red = true;
+    *link = new;
+    t->size++;
+
+    augment_path(t, new);
+    insert_fixup(t, new);
+}
+
+/* Restores the red-black properties after red element E has
+ * been inserted into T. */
+static void
+insert_fixup(struct rbtree *t, struct rb_elem *e)
+{
+    struct rb_elem *p;
+
+    while ((p = e->parent) != NULL && p->red) {
+        /* P is red, so it is not the root and has a parent. */
+        struct rb_elem *g = p->parent;
+
+        if (p == g->left) {
+            struct rb_elem *uncle = g->right;
+
+            if (is_red(uncle)) {
+                p->red = uncle->red = false;
+                g->red = true;
+                e = g;
+            } else {
+                if (e == p->right) {
+                    e = p;
+                    rotate_left(t, e);
+                    p = e->parent;
+                }
+                p->red = false;
+                g->red = true;
+                rotate_right(t, g);
+            }
+        } else {
+            struct rb_elem *uncle = g->left;
+
+            if (is_red(uncle)) {
+                p->red = uncle->red = false;
+                g->red = true;
+                e = g;
+            } else {
+                if (e == p->left) {
+                    e = p;
+                    rotate_right(t, e);
+                    p = e->parent;
+                }
+                p->red = false;
+                g->red = true;
+                rotate_left(t, g);
+            }
+        }
+    }
+    t->root->red = false;
+}
+
+/* Restores the red-black properties after a black element has
+ * been removed from T, leaving E (possibly null) in its place as
+ * a child of PARENT. */
+static void
+remove_fixup(struct rbtree *t, struct rb_elem *e, struct rb_elem *parent)
+{
+    while (e != t->root && !is_red(e)) {
+        /* E's subtree is one black element short, so E's sibling W
+         * cannot be null. */
+        if (e == parent->left) {
+            struct rb_elem *w = parent->right;
+
+            if (w->red) {
+                w->red = false;
+                parent->red = true;
+                rotate_left(t, parent);
+                w = parent->right;
+            }
+            if (!is_red(w->left) && !is_red(w->right)) {
+                w->red = true;
+                e = parent;
+                parent = e->parent;
+            } else {
+                if (!is_red(w->right)) {
+                    w->left->red = false;
+                    w->red = true;
+                    rotate_right(t, w);
+                    w = parent->right;
+                }
+                w->red = parent->red;
+                parent->red = false;
+                w->right->red = false;
+                rotate_left(t, parent);
+                e = t->root;
+            }
+        } else {
+            struct rb_elem *w = parent->left;
+
+            if (w->red) {
+                w->red = false;
+                parent->red = true;
+                rotate_right(t, parent);
+                w = parent->left;
+            }
+            if (!is_red(w->left) && !is_red(w->right)) {
+                w->red = true;
+                e = parent;
+                parent = e->parent;
+            } else {
+                if (!is_red(w->left)) {
+                    w->right->red = false;
+                    w->red = true;
+                    rotate_left(t, w);
+                    w = parent->left;
+                }
+                w->red = parent->red;
+                parent->red = false;
+                w->left->red = false;
+                rotate_right(t, parent);
+                e = t->root;
+            }
+        }
+    }
+    if (e != NULL) {
+        e->red = false;
+    }
+}
+
+/* Rotates E's right child Y up into E's place in T, making E
+ * Y's left child.  The set of elements in the subtree does not
+ * change, so only E's and Y's augmented data need updating. */
+static void
+rotate_left(struct rbtree *t, struct rb_elem *e)
+{
+    struct rb_elem *y = e->right;
+
+    e->right = y->left;
+    if (y->left != NULL) {
+        y->left->parent = e;
+    }
+    y->parent = e->parent;
+    replace_child(t, e, y);
+    y->left = e;
+    e->parent = y;
+
+    if (t->augment != NULL) {
+        t->augment(e, t->aux);
+        t->augment(y, t->aux);
+    }
+}
+
+/* Rotates E's left child Y up into E's place in T, making E
+ * Y's right child. */
+static void
+rotate_right(struct rbtree *t, struct rb_elem *e)
+{
+    struct rb_elem *y = e->left;
+
+    e->left = y->right;
+    if (y->right != NULL) {
+        y->right->parent = e;
+    }
+    y->parent = e->parent;
+    replace_child(t, e, y);
+    y->right = e;
+    e->parent = y;
+
+    if (t->augment != NULL) {
+        t->augment(e, t->aux);
+        t->augment(y, t->aux);
+    }
+}
+
+/* Recomputes the augmented data of E and each of its ancestors
+ * in T, bottom up. */
+static void
+augment_path(struct rbtree *t, struct rb_elem *e)
+{
+    if (t->augment != NULL) {
+        for (; e != NULL; e = e->parent) {
+            t->augment(e, t->aux);
+        }
+    }
+}
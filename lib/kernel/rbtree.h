@@ -0,0 +1,92 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+ *
+ * An ordered map for when a list is too slow to search and a
+ * hash cannot answer "the first element at or after X".  Lookup,
+ * insertion and removal take O(log n) time, and so does finding
+ * the first element not less than (rb_lower_bound()) or greater
+ * than (rb_upper_bound()) a key.  rb_first(), rb_last(),
+ * rb_next() and rb_prev() walk the elements in order.
+ *
+ * Like lists and hashes, the tree is intrusive: each structure
+ * that can be in a tree embeds a struct rb_elem member, and
+ * rb_entry() converts from it back to the structure.  Keys are
+ * compared by a less function supplied at initialization.
+ *
+ * A tree may also keep "augmented" data in its elements, such as
+ * the largest value in each subtree, which lets searches like
+ * "the lowest-addressed free extent of at least N pages" skip
+ * whole subtrees.  The augment function given to rb_init()
+ * recomputes that data for one element from the element itself
+ * and its two children.  The tree calls it, children before
+ * parents, on every element whose subtree it changes.  Code that
+ * searches on augmented data walks the tree directly through the
+ * LEFT and RIGHT members, starting from rb_root(). */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct rb_elem {
+    struct rb_elem *parent; /* Parent, or null for the root. */
+    struct rb_elem *left;   /* Left child: lesser elements. */
+    struct rb_elem *right;  /* Right child: greater elements. */
+    bool            red;    /* Red or black? */
+};
+
+/* Converts pointer to tree element RB_ELEM into a pointer to
+ * the structure that RB_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the tree element. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)      \
+    ((STRUCT *)((uint8_t *)&(RB_ELEM)->parent  \
+                - offsetof(STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+                           const struct rb_elem *b,
+                           void                 *aux);
+
+/* Recomputes the augmented data of tree element E from E and
+ * its children (which may be null), given auxiliary data AUX. */
+typedef void rb_augment_func (struct rb_elem *e, void *aux);
+
+/* Red-black tree. */
+struct rbtree {
+    struct rb_elem  *root;    /* Root element, or null if empty. */
+    size_t           size;    /* Number of elements. */
+    rb_less_func    *less;    /* Comparison function. */
+    rb_augment_func *augment; /* Augmented data function, or null. */
+    void            *aux;     /* Auxiliary data for `less' and `augment'. */
+};
+
+/* Initialization. */
+void rb_init(struct rbtree *, rb_less_func *, rb_augment_func *, void *aux);
+
+/* Insertion and removal. */
+struct rb_elem *rb_insert(struct rbtree *, struct rb_elem *);
+void rb_insert_multi(struct rbtree *, struct rb_elem *);
+void rb_remove(struct rbtree *, struct rb_elem *);
+
+/* Search. */
+struct rb_elem *rb_find(struct rbtree *, const struct rb_elem *);
+struct rb_elem *rb_lower_bound(struct rbtree *, const struct rb_elem *);
+struct rb_elem *rb_upper_bound(struct rbtree *, const struct rb_elem *);
+
+/* Traversal. */
+struct rb_elem *rb_first(struct rbtree *);
+struct rb_elem *rb_last(struct rbtree *);
+struct rb_elem *rb_next(struct rb_elem *);
+struct rb_elem *rb_prev(struct rb_elem *);
+struct rb_elem *rb_root(struct rbtree *);
+
+/* Information. */
+size_t rb_size(struct rbtree *);
+bool rb_empty(struct rbtree *);
+
+#endif /* lib/kernel/rbtree.h */
@@ -0,0 +1,516 @@
+/* Open-addressing hash table.
+ *
+ * See rhash.h for basic information. */
+
+#include "../debug.h"
+#include <string.h>
+#include "rhash.h"
+#include "threads/malloc.h"
+
+/* Multiplier that scrambles hash values: 2**32 divided by the
+ * golden ratio.  Slot indexes come from the product's top bits. */
+#define RHASH_MULTIPLIER 0x9e3779b1u
+
+/* Smallest number of slots in a table, a power of 2. */
+#define MIN_SLOTS 16
+
+/* Number of slots of the old table drained by each insertion
+ * or deletion while a resize is in progress.  A new table has
+ * twice as many slots as the one it replaces, so this is ample
+ * to finish draining before the new table fills up. */
+#define MIGRATE_SLOTS 8
+
+static bool table_init(struct rhash_table *, size_t slot_cnt);
+static struct rhash_slot *table_find(struct rhash *, struct rhash_table *,
+                                     unsigned hash, struct rhash_elem *);
+static void table_insert(struct rhash_table *, unsigned hash,
+                         struct rhash_elem *);
+static void table_remove(struct rhash_table *, struct rhash_slot *);
+static struct rhash_slot *find_slot(struct rhash *, unsigned hash,
+                                    struct rhash_elem *, struct rhash_table **);
+static bool grow(struct rhash *);
+static void migrate(struct rhash *, size_t slot_cnt);
+
+/* Initializes hash table H to compute hash values using HASH and
+ * compare hash elements using LESS, given auxiliary data AUX.
+ * Returns false if memory is not available. */
+bool
+rhash_init(struct rhash *h,
+           rhash_hash_func *hash, rhash_less_func *less, void *aux)
+{
+    h->elem_cnt = 0;
+    h->old.slots = NULL;
+    h->old.slot_cnt = h->old.elem_cnt = 0;
+    h->migrate_idx = 0;
+    h->hash = hash;
+    h->less = less;
+    h->aux = aux;
+    return table_init(&h->cur, MIN_SLOTS);
+}
+
+/* Removes all the elements from H.
+ *
+ * If DESTRUCTOR is non-null, then it is called for each element
+ * in the hash.  DESTRUCTOR may, if appropriate, deallocate the
+ * memory used by the hash element.  However, modifying hash
+ * table H while rhash_clear() is running, using any of the
+ * functions rhash_clear(), rhash_destroy(), rhash_insert(),
+ * rhash_replace(), rhash_delete() or rhash_remove(), yields
+ * undefined behavior, whether done in DESTRUCTOR or elsewhere. */
+void
+rhash_clear(struct rhash *h, rhash_action_func *destructor)
+{
+    if (destructor != NULL) {
+        rhash_apply(h, destructor);
+    }
+
+    free(h->old.slots);
+    h->old.slots = NULL;
+    h->old.slot_cnt = h->old.elem_cnt = 0;
+    h->migrate_idx = 0;
+
+    memset(h->cur.slots, 0, sizeof *h->cur.slots * h->cur.slot_cnt);
+    h->cur.elem_cnt = 0;
+    h->elem_cnt = 0;
+}
+
+/* Destroys hash table H.
+ *
+ * If DESTRUCTOR is non-null, then it is first called for each
+ * element in the hash, with the same restrictions as in
+ * rhash_clear(). */
+void
+rhash_destroy(struct rhash *h, rhash_action_func *destructor)
+{
+    rhash_clear(h, destructor);
+    free(h->cur.slots);
+}
+
+/* Inserts NEW into hash table H and returns a null pointer, if
+ * no equal element is already in the table.
+ * If an equal element is already in the table, returns it
+ * without inserting NEW.
+ * If H is full and memory for a bigger slot array is not
+ * available, returns NEW itself without inserting it. */
+struct rhash_elem *
+rhash_insert(struct rhash *h, struct rhash_elem *new)
+{
+    unsigned hash = h->hash(new, h->aux) * RHASH_MULTIPLIER;
+    struct rhash_slot *s = find_slot(h, hash, new, NULL);
+
+    if (s != NULL) {
+        return s->elem;
+    }
+
+    if (!grow(h)) {
+        return new;
+    }
+    new->hash = hash;
+    table_insert(&h->cur, hash, new);
+    h->elem_cnt++;
+    migrate(h, MIGRATE_SLOTS);
+    return NULL;
+}
+
+/* Inserts NEW into hash table H, replacing any equal element
+ * already in the table, which is returned.
+ * If there is no equal element, H is full, and memory for a
+ * bigger slot array is not available, returns NEW itself without
+ * inserting it. */
+struct rhash_elem *
+rhash_replace(struct rhash *h, struct rhash_elem *new)
+{
+    unsigned hash = h->hash(new, h->aux) * RHASH_MULTIPLIER;
+    struct rhash_slot *s = find_slot(h, hash, new, NULL);
+
+    if (s != NULL) {
+        struct rhash_elem *old = s->elem;
+
+        /* Equal elements hash alike, so NEW can take OLD's slot. */
+        new->hash = hash;
+        s->elem = new;
+        return old;
+    }
+
+    if (!grow(h)) {
+        return new;
+    }
+    new->hash = hash;
+    table_insert(&h->cur, hash, new);
+    h->elem_cnt++;
+    migrate(h, MIGRATE_SLOTS);
+    return NULL;
+}
+
+/* Finds and returns an element equal to E in hash table H, or a
+ * null pointer if no equal element exists in the table. */
+struct rhash_elem *
+rhash_find(struct rhash *h, struct rhash_elem *e)
+{
+    unsigned hash = h->hash(e, h->aux) * RHASH_MULTIPLIER;
+    struct rhash_slot *s = find_slot(h, hash, e, NULL);
+
+    return s != NULL ? s->elem : NULL;
+}
+
+/* Finds, removes, and returns an element equal to E in hash
+ * table H.  Returns a null pointer if no equal element existed
+ * in the table.
+ *
+ * If the elements of the hash table are dynamically allocated,
+ * or own resources that are, then it is the caller's
+ * responsibility to deallocate them. */
+struct rhash_elem *
+rhash_delete(struct rhash *h, struct rhash_elem *e)
+{
+    unsigned hash = h->hash(e, h->aux) * RHASH_MULTIPLIER;
+    struct rhash_table *t;
+    struct rhash_slot *s = find_slot(h, hash, e, &t);
+    struct rhash_elem *found = NULL;
+
+    if (s != NULL) {
+        found = s->elem;
+        table_remove(t, s);
+        h->elem_cnt--;
+        migrate(h, MIGRATE_SLOTS);
+    }
+    return found;
+}
+
+/* Removes E, which must be in hash table H, from H.  Unlike
+ * rhash_delete(), this uses the hash value cached in E and looks
+ * for E itself, so it never calls the hash function.  The less
+ * function is still called for any other element whose hash
+ * value equals E's. */
+void
+rhash_remove(struct rhash *h, struct rhash_elem *e)
+{
+    struct rhash_table *t;
+    struct rhash_slot *s = find_slot(h, e->hash, e, &t);
+
+    ASSERT(s != NULL && s->elem == e);
+    table_remove(t, s);
+    h->elem_cnt--;
+    migrate(h, MIGRATE_SLOTS);
+}
+
+/* Calls ACTION for each element in hash table H in arbitrary
+ * order.
+ * Modifying hash table H while rhash_apply() is running, using
+ * any of the functions rhash_clear(), rhash_destroy(),
+ * rhash_insert(), rhash_replace(), rhash_delete() or
+ * rhash_remove(), yields undefined behavior, whether done from
+ * ACTION or elsewhere. */
+void
+rhash_apply(struct rhash *h, rhash_action_func *action)
+{
+    struct rhash_iterator i;
+
+    ASSERT(action != NULL);
+
+    rhash_first(&i, h);
+    while (rhash_next(&i)) {
+        action(rhash_cur(&i), h->aux);
+    }
+}
+
+/* Initializes I for iterating hash table H.
+ *
+ * Iteration idiom:
+ *
+ *    struct rhash_iterator i;
+ *
+ *    rhash_first (&i, h);
+ *    while (rhash_next (&i))
+ *      {
+ *        struct foo *f = rhash_entry (rhash_cur (&i), struct foo, elem);
+ *        ...do something with f...
+ *      }
+ *
+ * Modifying hash table H during iteration, using any of the
+ * functions rhash_clear(), rhash_destroy(), rhash_insert(),
+ * rhash_replace(), rhash_delete() or rhash_remove(),
+ * invalidates all iterators. */
+void
+rhash_first(struct rhash_iterator *i, struct rhash *h)
+{
+    ASSERT(i != NULL);
+    ASSERT(h != NULL);
+
+    i->hash = h;
+    i->table = &h->cur;
+    i->idx = 0;
+    i->elem = NULL;
+}
+
+/* Advances I to the next element in the hash table and returns
+ * it.  Returns a null pointer if no elements are left.  Elements
+ * are returned in arbitrary order. */
+struct rhash_elem *
+rhash_next(struct rhash_iterator *i)
+{
+    ASSERT(i != NULL);
+
+    for (;;) {
+        if (i->idx < i->table->slot_cnt) {
+            struct rhash_slot *s = &i->table->slots[i->idx++];
+            if (s->elem != NULL) {
+                return i->elem = s->elem;
+            }
+        } else if (i->table == &i->hash->cur) {
+            i->table = &i->hash->old;
+            i->idx = 0;
+        } else {
+            return i->elem = NULL;
+        }
+    }
+}
+
+/* Returns the current element in the hash table iteration, or a
+ * null pointer at the end of the table.  Undefined behavior
+ * after calling rhash_first() but before rhash_next(). */
+struct rhash_elem *
+rhash_cur(struct rhash_iterator *i)
+{
+    return i->elem;
+}
+
+/* Returns the number of elements in H. */
+size_t
+rhash_size(struct rhash *h)
+{
+    return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+rhash_empty(struct rhash *h)
+{
+    return h->elem_cnt == 0;
+}
+
+/* Returns the number of bytes of slot arrays that H holds. */
+size_t
+rhash_table_bytes(const struct rhash *h)
+{
+    return (h->cur.slot_cnt + h->old.slot_cnt) * sizeof(struct rhash_slot);
+}
+
+/* Initializes T with SLOT_CNT empty slots, a power of 2.
+ * Returns false if memory is not available. */
+static bool
+table_init(struct rhash_table *t, size_t slot_cnt)
+{
+    ASSERT(slot_cnt >= MIN_SLOTS && (slot_cnt & (slot_cnt - 1)) == 0);
+
+    t->slots = calloc(slot_cnt, sizeof *t->slots);
+    if (t->slots == NULL) {
+        t->slot_cnt = t->elem_cnt = 0;
+        return false;
+    }
+    t->slot_cnt = slot_cnt;
+    t->shift = 32;
+    while (slot_cnt > 1) {
+        t->shift--;
+        slot_cnt /= 2;
+    }
+    t->elem_cnt = 0;
+    return true;
+}
+
+/* Returns the index of the slot in T where an element with
+ * scrambled hash value HASH would ideally go. */
+static inline size_t
+home_slot(const struct rhash_table *t, unsigned hash)
+{
+    return hash >> t->shift;
+}
+
+/* Returns how many slots past its home slot the element in slot
+ * IDX of T is. */
+static inline size_t
+probe_distance(const struct rhash_table *t, size_t idx)
+{
+    return (idx - home_slot(t, t->slots[idx].hash)) & (t->slot_cnt - 1);
+}
+
+/* Searches T for an element with scrambled hash value HASH that
+ * is E itself or equal to it, and returns its slot, or a null
+ * pointer if there is none. */
+static struct rhash_slot *
+table_find(struct rhash *h, struct rhash_table *t, unsigned hash,
+           struct rhash_elem *e)
+{
+    size_t mask = t->slot_cnt - 1;
+    size_t idx, dist;
+
+    if (t->elem_cnt == 0) {
+        return NULL;
+    }
+
+    /* Robin Hood insertion never lets an element sit farther from
+     * home than one it passed, so we can stop at the first slot
+     * whose element is closer to home than we are. */
+    idx = home_slot(t, hash);
+    for (dist = 0; ; dist++, idx = (idx + 1) & mask) {
+        struct rhash_slot *s = &t->slots[idx];
+
+        if (s->elem == NULL || probe_distance(t, idx) < dist) {
+            return NULL;
+        }
+        if (s->hash == hash
+            && (s->elem == e
+                || (!h->less(s->elem, e, h->aux)
+                    && !h->less(e, s->elem, h->aux)))) {
+            return s;
+        }
+    }
+}
+
+/* Inserts element E, with scrambled hash value HASH, into T,
+ * which must have an empty slot and no element equal to E. */
+static void
+table_insert(struct rhash_table *t, unsigned hash, struct rhash_elem *e)
+{
+    size_t mask = t->slot_cnt - 1;
+    size_t idx = home_slot(t, hash);
+    size_t dist = 0;
+
+    ASSERT(t->elem_cnt < t->slot_cnt);
+    t->elem_cnt++;
+    for (;;) {
+        struct rhash_slot *s = &t->slots[idx];
+        size_t s_dist;
+
+        if (s->elem == NULL) {
+            s->hash = hash;
+            s->elem = e;
+            return;
+        }
+
+        /* Take the slot from an element closer to its home, and
+         * carry on inserting that element instead. */
+        s_dist = probe_distance(t, idx);
+        if (s_dist < dist) {
+            struct rhash_slot displaced = *s;
+
+            s->hash = hash;
+            s->elem = e;
+            hash = displaced.hash;
+            e = displaced.elem;
+            dist = s_dist;
+        }
+        idx = (idx + 1) & mask;
+        dist++;
+    }
+}
+
+/* Empties slot S of T by shifting back the elements that follow
+ * it, until one that is already in its home slot. */
+static void
+table_remove(struct rhash_table *t, struct rhash_slot *s)
+{
+    size_t mask = t->slot_cnt - 1;
+    size_t idx = s - t->slots;
+
+    for (;;) {
+        size_t next = (idx + 1) & mask;
+
+        if (t->slots[next].elem == NULL || probe_distance(t, next) == 0) {
+            break;
+        }
+        t->slots[idx] = t->slots[next];
+        idx = next;
+    }
+    t->slots[idx].elem = NULL;
+    t->elem_cnt--;
+}
+
+/* Returns the slot in H of the element with scrambled hash value
+ * HASH that is E itself or equal to it, or a null pointer if
+ * there is none.  If TABLE is nonnull, stores the slot array
+ * where it was found into *TABLE. */
+static struct rhash_slot *
+find_slot(struct rhash *h, unsigned hash, struct rhash_elem *e,
+          struct rhash_table **table)
+{
+    struct rhash_slot *s = table_find(h, &h->cur, hash, e);
+
+    if (s != NULL) {
+        if (table != NULL) {
+            *table = &h->cur;
+        }
+        return s;
+    }
+
+    s = table_find(h, &h->old, hash, e);
+    if (s != NULL && table != NULL) {
+        *table = &h->old;
+    }
+    return s;
+}
+
+/* Makes room in H for one more element, starting a resize if
+ * the current slot array is three-quarters full.  If memory for
+ * a bigger array is not available, the current one is used
+ * until it is completely full.  Returns false if there is no
+ * room, true otherwise. */
+static bool
+grow(struct rhash *h)
+{
+    struct rhash_table bigger;
+
+    if ((h->cur.elem_cnt + 1) * 4 <= h->cur.slot_cnt * 3) {
+        return true;
+    }
+
+    /* Finish any resize that is still in progress: OLD can only
+     * be drained into CUR. */
+    migrate(h, SIZE_MAX);
+
+    if (table_init(&bigger, h->cur.slot_cnt * 2)) {
+        h->old = h->cur;
+        h->cur = bigger;
+        h->migrate_idx = 0;
+    } else if (h->cur.elem_cnt + 1 >= h->cur.slot_cnt) {
+        /* A table needs an empty slot to end unsuccessful
+         * searches. */
+        return false;
+    }
+    return true;
+}
+
+/* Moves the elements in up to SLOT_CNT slots of H's old slot
+ * array, if any, into the current one, and frees the old array
+ * once it is empty. */
+static void
+migrate(struct rhash *h, size_t slot_cnt)
+{
+    struct rhash_table *old = &h->old;
+
+    while (old->slots != NULL && slot_cnt-- > 0) {
+        struct rhash_slot *s;
+
+        if (old->elem_cnt == 0) {
+            free(old->slots);
+            old->slots = NULL;
+            old->slot_cnt = 0;
+            break;
+        }
+
+        /* Nothing is ever inserted into OLD, so the slots before
+         * MIGRATE_IDX stay empty and removing from MIGRATE_IDX can
+         * only pull later elements back into it. */
+        ASSERT(h->migrate_idx < old->slot_cnt);
+        s = &old->slots[h->migrate_idx];
+        if (s->elem != NULL) {
+            unsigned hash = s->hash;
+            struct rhash_elem *e = s->elem;
+
+            table_remove(old, s);
+            table_insert(&h->cur, hash, e);
+        } else {
+            h->migrate_idx++;
+        }
+    }
+}
@@ -0,0 +1,118 @@
+#ifndef __LIB_KERNEL_RHASH_H
+#define __LIB_KERNEL_RHASH_H
+
+/* Open-addressing hash table.
+ *
+ * An alternative to the chained hash table in hash.h with nearly
+ * the same interface.  Like struct hash_elem, each structure that
+ * can be in an rhash embeds a struct rhash_elem member, and
+ * rhash_entry() converts back to the containing structure.
+ *
+ * The table is a single array of slots, each holding a pointer to
+ * an element and that element's hash value.  Collisions are
+ * resolved by linear probing with "Robin Hood" insertion: an
+ * element that is farther from its home slot takes the place of
+ * one that is closer, which keeps every probe sequence short.  A
+ * lookup compares cached hash values as it walks the array and
+ * calls the less function only on a full hash match, so it
+ * touches element memory only for elements that (almost
+ * certainly) are the one sought.
+ *
+ * Growing the table does not move every element at once.  The
+ * old slot array is kept and drained a few slots at a time by
+ * later insertions and deletions, so no single operation pays
+ * for the whole resize.  Lookups check both arrays meanwhile.
+ *
+ * Hash values are scrambled by multiplication before use, so
+ * hash functions that just return a key (such as a page number)
+ * are fine. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Hash element. */
+struct rhash_elem {
+    unsigned hash; /* Scrambled hash value, set on insertion. */
+};
+
+/* Converts pointer to hash element RHASH_ELEM into a pointer to
+ * the structure that RHASH_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the hash element. */
+#define rhash_entry(RHASH_ELEM, STRUCT, MEMBER) \
+    ((STRUCT *)((uint8_t *)&(RHASH_ELEM)->hash  \
+                - offsetof(STRUCT, MEMBER.hash)))
+
+/* Computes and returns the hash value for hash element E, given
+ * auxiliary data AUX. */
+typedef unsigned rhash_hash_func (const struct rhash_elem *e, void *aux);
+
+/* Compares the value of two hash elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool rhash_less_func (const struct rhash_elem *a,
+                              const struct rhash_elem *b,
+                              void                    *aux);
+
+/* Performs some operation on hash element E, given auxiliary
+ * data AUX. */
+typedef void rhash_action_func (struct rhash_elem *e, void *aux);
+
+/* A slot: an element and its cached hash value. */
+struct rhash_slot {
+    unsigned           hash; /* Scrambled hash value of ELEM. */
+    struct rhash_elem *elem; /* Element, or null if slot is empty. */
+};
+
+/* An array of slots. */
+struct rhash_table {
+    struct rhash_slot *slots;    /* Array of `slot_cnt' slots. */
+    size_t             slot_cnt; /* Number of slots, a power of 2. */
+    unsigned           shift;    /* 32 - log2(slot_cnt). */
+    size_t             elem_cnt; /* Number of elements in slots. */
+};
+
+/* Hash table. */
+struct rhash {
+    size_t             elem_cnt;    /* Number of elements in table. */
+    struct rhash_table cur;         /* Slots that take insertions. */
+    struct rhash_table old;         /* Slots being drained into CUR. */
+    size_t             migrate_idx; /* Next slot of OLD to drain. */
+    rhash_hash_func   *hash;        /* Hash function. */
+    rhash_less_func   *less;        /* Comparison function. */
+    void              *aux;         /* Auxiliary data for `hash' and `less'. */
+};
+
+/* A hash table iterator. */
+struct rhash_iterator {
+    struct rhash       *hash;  /* The hash table. */
+    struct rhash_table *table; /* Current slot array. */
+    size_t              idx;   /* Next slot in TABLE. */
+    struct rhash_elem  *elem;  /* Current hash element. */
+};
+
+/* Basic life cycle. */
+bool rhash_init(struct rhash *, rhash_hash_func *, rhash_less_func *, void *aux);
+void rhash_clear(struct rhash *, rhash_action_func *);
+void rhash_destroy(struct rhash *, rhash_action_func *);
+
+/* Search, insertion, deletion. */
+struct rhash_elem *rhash_insert(struct rhash *, struct rhash_elem *);
+struct rhash_elem *rhash_replace(struct rhash *, struct rhash_elem *);
+struct rhash_elem *rhash_find(struct rhash *, struct rhash_elem *);
+struct rhash_elem *rhash_delete(struct rhash *, struct rhash_elem *);
+void rhash_remove(struct rhash *, struct rhash_elem *);
+
+/* Iteration. */
+void rhash_apply(struct rhash *, rhash_action_func *);
+void rhash_first(struct rhash_iterator *, struct rhash *);
+struct rhash_elem *rhash_next(struct rhash_iterator *);
+struct rhash_elem *rhash_cur(struct rhash_iterator *);
+
+/* Information. */
+size_t rhash_size(struct rhash *);
+bool rhash_empty(struct rhash *);
+size_t rhash_table_bytes(const struct rhash *);
+
+#endif /* lib/kernel/rhash.h */
@@ -27,7 +27,11 @@ enum {
     SYS_MKDIR,   /* Create a directory. */
     SYS_READDIR, /* Reads a directory entry. */
     SYS_ISDIR,   /* Tests if a fd represents a directory. */
-    SYS_INUMBER  /* Returns the inode number for a fd. */
+    SYS_INUMBER, /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_INTR_STATS, /* Reports interrupt statistics. */
+    SYS_VM_STATS    /* Returns the process's VM metadata bytes. */
 };
 
 #endif /* lib/syscall-nr.h */
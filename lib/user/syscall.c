@@ -182,3 +182,15 @@ inumber(int fd)
 {
     return syscall1(SYS_INUMBER, fd);
 }
+
+int
+intr_stats(char *buffer, unsigned size)
+{
+    return syscall2(SYS_INTR_STATS, buffer, size);
+}
+
+int
+vm_stats(void)
+{
+    return syscall0(SYS_VM_STATS);
+}
@@ -45,4 +45,8 @@ bool readdir(int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir(int fd);
 int inumber(int fd);
 
+/* Extensions. */
+int intr_stats(char *buffer, unsigned size);
+int vm_stats(void);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,178 @@
+/* Test program for lib/kernel/heap.c.
+
+   Runs a random mix of pushes, pops, removals of arbitrary
+   elements and key decreases, and after every change checks the
+   heap order, the sibling and parent links, the size and the
+   minimum against a plain array of keys.  Finally empties the
+   heap with heap_pop_min() and checks that the keys come out in
+   sorted order.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <heap.h>
+#include <limits.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Maximum number of elements in a heap that we will test. */
+#define MAX_SIZE 128
+
+/* Keys are drawn from [0, KEY_RANGE). */
+#define KEY_RANGE 1000
+
+/* A heap element. */
+struct value
+  {
+    struct heap_elem elem;      /* Heap element. */
+    int key;                    /* Sort key. */
+    bool in;                    /* In the heap? */
+  };
+
+static struct value values[MAX_SIZE];
+
+static void test_heap (void);
+static void verify_heap (struct heap *);
+
+/* Test the pairing heap implementation. */
+void
+test (void)
+{
+  printf ("testing pairing heap...");
+  test_heap ();
+  printf (" done\n");
+
+  printf ("heap: PASS\n");
+}
+
+static bool
+value_less (const struct heap_elem *a_, const struct heap_elem *b_,
+            void *aux UNUSED)
+{
+  const struct value *a = heap_entry (a_, struct value, elem);
+  const struct value *b = heap_entry (b_, struct value, elem);
+  return a->key < b->key;
+}
+
+/* Runs random operations on a heap, checking it after each. */
+static void
+test_heap (void)
+{
+  struct heap heap;
+  int round, op;
+
+  for (round = 0; round < 8; round++)
+    {
+      int last;
+      size_t i;
+
+      heap_init (&heap, value_less, NULL);
+      for (i = 0; i < MAX_SIZE; i++)
+        values[i].in = false;
+
+      for (op = 0; op < 8 * MAX_SIZE; op++)
+        {
+          struct value *v = &values[random_ulong () % MAX_SIZE];
+
+          switch (random_ulong () % 4)
+            {
+            case 0:
+            case 1:
+              if (!v->in)
+                {
+                  v->key = random_ulong () % KEY_RANGE;
+                  heap_push (&heap, &v->elem);
+                  v->in = true;
+                }
+              break;
+
+            case 2:
+              if (v->in && random_ulong () % 2)
+                {
+                  heap_remove (&heap, &v->elem);
+                  v->in = false;
+                }
+              else if (!heap_empty (&heap))
+                {
+                  struct heap_elem *min = heap_min (&heap);
+                  ASSERT (heap_pop_min (&heap) == min);
+                  heap_entry (min, struct value, elem)->in = false;
+                }
+              break;
+
+            case 3:
+              if (v->in)
+                {
+                  v->key -= random_ulong () % (KEY_RANGE / 4);
+                  heap_decrease (&heap, &v->elem);
+                }
+              break;
+            }
+          verify_heap (&heap);
+        }
+
+      /* Drain in order. */
+      for (last = INT_MIN; !heap_empty (&heap); )
+        {
+          struct value *v = heap_entry (heap_pop_min (&heap),
+                                        struct value, elem);
+          ASSERT (v->in && v->key >= last);
+          last = v->key;
+          v->in = false;
+        }
+      verify_heap (&heap);
+    }
+}
+
+/* Checks E and its following siblings, which are children of
+   PARENT (null for the root), and their subtrees.  E's back link
+   should be PREV.  Returns the number of elements checked. */
+static size_t
+verify_siblings (struct heap_elem *e, struct heap_elem *prev,
+                 struct heap_elem *parent)
+{
+  size_t cnt = 0;
+
+  for (; e != NULL; prev = e, e = e->next)
+    {
+      struct value *v = heap_entry (e, struct value, elem);
+
+      ASSERT (v->in);
+      ASSERT (e->prev == prev);
+      ASSERT (parent == NULL
+              || heap_entry (parent, struct value, elem)->key <= v->key);
+      cnt += 1 + verify_siblings (e->child, e, e);
+    }
+  return cnt;
+}
+
+/* Checks HEAP against the IN flags and keys of values[]. */
+static void
+verify_heap (struct heap *heap)
+{
+  struct heap_elem *root = heap_min (heap);
+  size_t cnt = 0;
+  int min = 0;
+  size_t i;
+
+  for (i = 0; i < MAX_SIZE; i++)
+    if (values[i].in)
+      {
+        if (cnt == 0 || values[i].key < min)
+          min = values[i].key;
+        cnt++;
+      }
+  ASSERT (heap_size (heap) == cnt);
+  ASSERT (heap_empty (heap) == (cnt == 0));
+
+  if (root != NULL)
+    {
+      ASSERT (root->prev == NULL && root->next == NULL);
+      ASSERT (heap_entry (root, struct value, elem)->key == min);
+    }
+  ASSERT (verify_siblings (root, NULL, NULL) == cnt);
+}
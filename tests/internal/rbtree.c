@@ -0,0 +1,254 @@
+/* Test program for lib/kernel/rbtree.c.
+
+   Inserts and removes elements in random order, with and without
+   duplicate keys, and after every change checks the red-black
+   properties, the parent links, in-order traversal in both
+   directions, rb_find(), rb_lower_bound() and rb_upper_bound()
+   against a sorted array, and augmented data (subtree size and
+   subtree maximum of a second field) against a recomputation.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <rbtree.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Maximum number of elements in a tree that we will test. */
+#define MAX_SIZE 128
+
+/* Keys are drawn from [0, KEY_RANGE). */
+#define KEY_RANGE (2 * MAX_SIZE)
+
+/* A tree element. */
+struct value
+  {
+    struct rb_elem elem;        /* Tree element. */
+    int key;                    /* Sort key. */
+    int weight;                 /* Value for subtree_max. */
+    size_t subtree_size;        /* Augmented: elements in subtree. */
+    int subtree_max;            /* Augmented: max weight in subtree. */
+    bool in;                    /* In the tree? */
+  };
+
+static struct value values[MAX_SIZE];
+
+static void test_tree (bool multi);
+static void verify_tree (struct rbtree *, bool multi);
+
+/* Test the red-black tree implementation. */
+void
+test (void)
+{
+  printf ("testing red-black tree with unique keys...");
+  test_tree (false);
+  printf (" done\n");
+
+  printf ("testing red-black tree with duplicate keys...");
+  test_tree (true);
+  printf (" done\n");
+
+  printf ("rbtree: PASS\n");
+}
+
+static bool
+value_less (const struct rb_elem *a_, const struct rb_elem *b_,
+            void *aux UNUSED)
+{
+  const struct value *a = rb_entry (a_, struct value, elem);
+  const struct value *b = rb_entry (b_, struct value, elem);
+  return a->key < b->key;
+}
+
+static void
+value_augment (struct rb_elem *e_, void *aux UNUSED)
+{
+  struct value *e = rb_entry (e_, struct value, elem);
+
+  e->subtree_size = 1;
+  e->subtree_max = e->weight;
+  if (e_->left != NULL)
+    {
+      struct value *l = rb_entry (e_->left, struct value, elem);
+      e->subtree_size += l->subtree_size;
+      if (l->subtree_max > e->subtree_max)
+        e->subtree_max = l->subtree_max;
+    }
+  if (e_->right != NULL)
+    {
+      struct value *r = rb_entry (e_->right, struct value, elem);
+      e->subtree_size += r->subtree_size;
+      if (r->subtree_max > e->subtree_max)
+        e->subtree_max = r->subtree_max;
+    }
+}
+
+/* Runs random insertions and removals on a tree, checking it
+   after each.  If MULTI, keys may repeat. */
+static void
+test_tree (bool multi)
+{
+  struct rbtree tree;
+  int round, op;
+
+  for (round = 0; round < 8; round++)
+    {
+      size_t i;
+
+      rb_init (&tree, value_less, value_augment, NULL);
+      for (i = 0; i < MAX_SIZE; i++)
+        {
+          values[i].key = multi ? (int) (random_ulong () % (MAX_SIZE / 4))
+                                : (int) i * 2;
+          values[i].weight = random_ulong () % 1000;
+          values[i].in = false;
+        }
+
+      for (op = 0; op < 4 * MAX_SIZE; op++)
+        {
+          struct value *v = &values[random_ulong () % MAX_SIZE];
+
+          /* Bias towards growing during the first half of each
+             round and shrinking during the second. */
+          if (!v->in && (op < 2 * MAX_SIZE || random_ulong () % 4 == 0))
+            {
+              if (multi)
+                rb_insert_multi (&tree, &v->elem);
+              else
+                ASSERT (rb_insert (&tree, &v->elem) == NULL);
+              v->in = true;
+            }
+          else if (v->in)
+            {
+              rb_remove (&tree, &v->elem);
+              v->in = false;
+            }
+          else if (!multi)
+            {
+              /* Inserting an equal element must fail. */
+              struct value *w;
+              for (w = values; w < values + MAX_SIZE; w++)
+                if (w->in)
+                  {
+                    struct value dup = *w;
+                    ASSERT (rb_insert (&tree, &dup.elem) == &w->elem);
+                    break;
+                  }
+            }
+          verify_tree (&tree, multi);
+        }
+    }
+}
+
+/* Checks the subtree rooted at E, whose parent should be PARENT,
+   and returns its black height. */
+static int
+verify_subtree (struct rb_elem *e, struct rb_elem *parent)
+{
+  struct value *v;
+  size_t size;
+  int max, left_height, right_height;
+
+  if (e == NULL)
+    return 1;
+
+  ASSERT (e->parent == parent);
+  ASSERT (!e->red || ((e->left == NULL || !e->left->red)
+                       && (e->right == NULL || !e->right->red)));
+
+  left_height = verify_subtree (e->left, e);
+  right_height = verify_subtree (e->right, e);
+  ASSERT (left_height == right_height);
+
+  v = rb_entry (e, struct value, elem);
+  size = 1;
+  max = v->weight;
+  if (e->left != NULL)
+    {
+      struct value *l = rb_entry (e->left, struct value, elem);
+      size += l->subtree_size;
+      max = l->subtree_max > max ? l->subtree_max : max;
+    }
+  if (e->right != NULL)
+    {
+      struct value *r = rb_entry (e->right, struct value, elem);
+      size += r->subtree_size;
+      max = r->subtree_max > max ? r->subtree_max : max;
+    }
+  ASSERT (v->subtree_size == size);
+  ASSERT (v->subtree_max == max);
+
+  return left_height + !e->red;
+}
+
+/* Checks TREE against the IN flags of values[]. */
+static void
+verify_tree (struct rbtree *tree, bool multi)
+{
+  int sorted[MAX_SIZE];
+  size_t cnt = 0;
+  size_t i, j;
+  struct rb_elem *e;
+  int key;
+
+  /* Collect and insertion-sort the keys that should be present. */
+  for (i = 0; i < MAX_SIZE; i++)
+    if (values[i].in)
+      {
+        for (j = cnt++; j > 0 && sorted[j - 1] > values[i].key; j--)
+          sorted[j] = sorted[j - 1];
+        sorted[j] = values[i].key;
+      }
+  ASSERT (rb_size (tree) == cnt);
+  ASSERT (rb_empty (tree) == (cnt == 0));
+
+  /* Shape, colors and augmented data. */
+  ASSERT (rb_root (tree) == NULL || !rb_root (tree)->red);
+  verify_subtree (rb_root (tree), NULL);
+
+  /* Forward and backward traversal. */
+  for (i = 0, e = rb_first (tree); e != NULL; i++, e = rb_next (e))
+    ASSERT (i < cnt && rb_entry (e, struct value, elem)->key == sorted[i]);
+  ASSERT (i == cnt);
+  for (i = cnt, e = rb_last (tree); e != NULL; e = rb_prev (e))
+    ASSERT (i > 0 && rb_entry (e, struct value, elem)->key == sorted[--i]);
+  ASSERT (i == 0);
+
+  /* Searches, for every key in range and one past each end. */
+  for (key = -1; key <= KEY_RANGE; key++)
+    {
+      struct value probe;
+      struct rb_elem *lower, *upper, *found;
+      size_t lower_idx = 0, upper_idx = 0;
+
+      while (lower_idx < cnt && sorted[lower_idx] < key)
+        lower_idx++;
+      upper_idx = lower_idx;
+      while (upper_idx < cnt && sorted[upper_idx] <= key)
+        upper_idx++;
+
+      probe.key = key;
+      lower = rb_lower_bound (tree, &probe.elem);
+      upper = rb_upper_bound (tree, &probe.elem);
+      found = rb_find (tree, &probe.elem);
+
+      ASSERT (lower_idx < cnt
+              ? lower != NULL && (rb_entry (lower, struct value, elem)->key
+                                  == sorted[lower_idx])
+              : lower == NULL);
+      ASSERT (upper_idx < cnt
+              ? upper != NULL && (rb_entry (upper, struct value, elem)->key
+                                  == sorted[upper_idx])
+              : upper == NULL);
+
+      /* rb_find() returns the first equal element, which is the
+         lower bound. */
+      ASSERT (found == (upper_idx > lower_idx ? lower : NULL));
+      ASSERT (!multi || found == NULL || rb_prev (found) == NULL
+              || rb_entry (rb_prev (found), struct value, elem)->key < key);
+    }
+}
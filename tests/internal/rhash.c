@@ -0,0 +1,258 @@
+/* Test program for lib/kernel/rhash.c.
+
+   Runs a random mix of insertions, deletions and lookups against
+   an rhash and checks every result against a plain array of
+   flags.  Then times successful and unsuccessful lookups in an
+   rhash and in a chained hash (lib/kernel/hash.c) holding the
+   same 10**3, 10**4 and 10**5 elements.  The largest size needs
+   a couple of megabytes of kernel pool, so run it with enough
+   memory (e.g. "pintos -m 32"); sizes that do not fit are
+   skipped.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <random.h>
+#include <rhash.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+#include "threads/test.h"
+
+/* Number of elements in the correctness test. */
+#define VERIFY_SIZE 4096
+
+/* Number of operations in the correctness test. */
+#define VERIFY_OPS 100000
+
+/* Largest number of elements that we will time. */
+#define MAX_SIZE 100000
+
+/* Number of timed lookups at each size. */
+#define LOOKUPS 100000
+
+/* An element in both kinds of table. */
+struct value
+  {
+    int key;                    /* Key. */
+    bool in;                    /* In the table? */
+    struct hash_elem h_elem;    /* Element in a struct hash. */
+    struct rhash_elem r_elem;   /* Element in a struct rhash. */
+  };
+
+static void verify (void);
+static void benchmark (size_t size);
+
+/* Test the open-addressing hash table. */
+void
+test (void)
+{
+  size_t size;
+
+  verify ();
+  printf ("%8s %12s %12s %12s %12s\n", "elements", "hash-hit",
+          "rhash-hit", "hash-miss", "rhash-miss");
+  for (size = 1000; size <= MAX_SIZE; size *= 10)
+    benchmark (size);
+  printf ("rhash: PASS\n");
+}
+
+/* Hash and comparison functions for both tables. */
+static unsigned
+value_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct value, h_elem)->key);
+}
+
+static bool
+value_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct value, h_elem)->key
+          < hash_entry (b, struct value, h_elem)->key);
+}
+
+static unsigned
+value_rhash (const struct rhash_elem *e, void *aux UNUSED)
+{
+  return hash_int (rhash_entry (e, struct value, r_elem)->key);
+}
+
+static bool
+value_rless (const struct rhash_elem *a, const struct rhash_elem *b,
+             void *aux UNUSED)
+{
+  return (rhash_entry (a, struct value, r_elem)->key
+          < rhash_entry (b, struct value, r_elem)->key);
+}
+
+/* Checks rhash_insert(), rhash_find(), rhash_delete(),
+   rhash_remove() and iteration against a table of flags, across
+   many resizes. */
+static void
+verify (void)
+{
+  struct value *values = malloc (sizeof *values * VERIFY_SIZE);
+  struct rhash h;
+  size_t live = 0;
+  int op;
+  int i;
+
+  printf ("verifying rhash...");
+  ASSERT (values != NULL);
+  ASSERT (rhash_init (&h, value_rhash, value_rless, NULL));
+  for (i = 0; i < VERIFY_SIZE; i++)
+    {
+      values[i].key = i * 4096;
+      values[i].in = false;
+    }
+
+  for (op = 0; op < VERIFY_OPS; op++)
+    {
+      struct value *v = &values[random_ulong () % VERIFY_SIZE];
+      struct value key;
+      struct rhash_elem *e;
+
+      key.key = v->key;
+      switch (random_ulong () % 4)
+        {
+        case 0:
+        case 1:
+          e = rhash_insert (&h, &v->r_elem);
+          ASSERT (v->in ? e == &v->r_elem : e == NULL);
+          if (!v->in)
+            {
+              v->in = true;
+              live++;
+            }
+          break;
+
+        case 2:
+          if (v->in && random_ulong () % 2)
+            rhash_remove (&h, &v->r_elem);
+          else
+            ASSERT (rhash_delete (&h, &key.r_elem)
+                    == (v->in ? &v->r_elem : NULL));
+          if (v->in)
+            {
+              v->in = false;
+              live--;
+            }
+          break;
+
+        case 3:
+          ASSERT (rhash_find (&h, &key.r_elem)
+                  == (v->in ? &v->r_elem : NULL));
+          break;
+        }
+      ASSERT (rhash_size (&h) == live);
+
+      if (op % 10000 == 0)
+        {
+          struct rhash_iterator it;
+          size_t cnt = 0;
+
+          rhash_first (&it, &h);
+          while (rhash_next (&it))
+            {
+              ASSERT (rhash_entry (rhash_cur (&it), struct value,
+                                   r_elem)->in);
+              cnt++;
+            }
+          ASSERT (cnt == live);
+        }
+    }
+
+  rhash_destroy (&h, NULL);
+  free (values);
+  printf (" done\n");
+}
+
+/* Returns the time stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Fills a hash and an rhash with SIZE elements and prints the
+   average cycles per successful and per unsuccessful lookup in
+   each. */
+static void
+benchmark (size_t size)
+{
+  struct value *values = malloc (sizeof *values * size);
+  struct hash h;
+  struct rhash r;
+  uint64_t start, t[4];
+  struct value key;
+  size_t i;
+
+  if (values == NULL || !hash_init (&h, value_hash, value_less, NULL))
+    {
+      printf ("%8zu skipped: out of memory\n", size);
+      free (values);
+      return;
+    }
+  if (!rhash_init (&r, value_rhash, value_rless, NULL))
+    {
+      printf ("%8zu skipped: out of memory\n", size);
+      hash_destroy (&h, NULL);
+      free (values);
+      return;
+    }
+
+  /* Even keys are in the tables, odd keys are not. */
+  for (i = 0; i < size; i++)
+    {
+      values[i].key = i * 2;
+      hash_insert (&h, &values[i].h_elem);
+      rhash_insert (&r, &values[i].r_elem);
+    }
+
+  start = rdtsc ();
+  for (i = 0; i < LOOKUPS; i++)
+    {
+      key.key = (random_ulong () % size) * 2;
+      ASSERT (hash_find (&h, &key.h_elem) != NULL);
+    }
+  t[0] = rdtsc () - start;
+
+  start = rdtsc ();
+  for (i = 0; i < LOOKUPS; i++)
+    {
+      key.key = (random_ulong () % size) * 2;
+      ASSERT (rhash_find (&r, &key.r_elem) != NULL);
+    }
+  t[1] = rdtsc () - start;
+
+  start = rdtsc ();
+  for (i = 0; i < LOOKUPS; i++)
+    {
+      key.key = (random_ulong () % size) * 2 + 1;
+      ASSERT (hash_find (&h, &key.h_elem) == NULL);
+    }
+  t[2] = rdtsc () - start;
+
+  start = rdtsc ();
+  for (i = 0; i < LOOKUPS; i++)
+    {
+      key.key = (random_ulong () % size) * 2 + 1;
+      ASSERT (rhash_find (&r, &key.r_elem) == NULL);
+    }
+  t[3] = rdtsc () - start;
+
+  printf ("%8zu %12"PRIu64" %12"PRIu64" %12"PRIu64" %12"PRIu64"\n",
+          size, t[0] / LOOKUPS, t[1] / LOOKUPS, t[2] / LOOKUPS,
+          t[3] / LOOKUPS);
+
+  rhash_destroy (&r, NULL);
+  hash_destroy (&h, NULL);
+  free (values);
+}
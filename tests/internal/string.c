@@ -0,0 +1,175 @@
+/* Test program for the block functions in lib/string.c.
+
+   Checks memcpy(), memmove(), memset() and memcmp() against
+   simple byte-at-a-time loops for every combination of small
+   size and alignment, then compares their throughput against
+   those loops across a range of block sizes.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/test.h"
+
+/* Largest block that we will copy, plus slack for alignment. */
+#define MAX_SIZE 8192
+#define SLACK 8
+
+/* Number of times each timed operation is repeated. */
+#define REPEAT 64
+
+static uint8_t src[MAX_SIZE + SLACK];
+static uint8_t dst[MAX_SIZE + SLACK];
+static uint8_t ref[MAX_SIZE + SLACK];
+
+static void verify (void);
+static void benchmark (void);
+
+/* Test the block functions. */
+void
+test (void)
+{
+  verify ();
+  benchmark ();
+  printf ("string: PASS\n");
+}
+
+/* Reference implementations. */
+static void
+byte_copy (uint8_t *d, const uint8_t *s, size_t size)
+{
+  while (size-- > 0)
+    *d++ = *s++;
+}
+
+static void
+byte_set (uint8_t *d, uint8_t value, size_t size)
+{
+  while (size-- > 0)
+    *d++ = value;
+}
+
+/* Fills BUF with random bytes. */
+static void
+randomize (uint8_t *buf, size_t size)
+{
+  random_bytes (buf, size);
+}
+
+/* Checks each function for every size up to 64 bytes at every
+   combination of source and destination alignment. */
+static void
+verify (void)
+{
+  size_t size;
+  int s_ofs, d_ofs;
+
+  printf ("verifying block functions:");
+  for (size = 0; size <= 64; size++)
+    {
+      printf (" %zu", size);
+      for (s_ofs = 0; s_ofs < SLACK; s_ofs++)
+        for (d_ofs = 0; d_ofs < SLACK; d_ofs++)
+          {
+            uint8_t value = random_ulong ();
+
+            /* memcpy. */
+            randomize (src, sizeof src);
+            randomize (dst, sizeof dst);
+            memcpy (ref, dst, sizeof ref);
+            ASSERT (memcpy (dst + d_ofs, src + s_ofs, size) == dst + d_ofs);
+            byte_copy (ref + d_ofs, src + s_ofs, size);
+            ASSERT (!memcmp (dst, ref, sizeof dst));
+
+            /* memmove, overlapping in both directions. */
+            memcpy (ref, dst, sizeof ref);
+            ASSERT (memmove (dst + d_ofs, dst + s_ofs, size) == dst + d_ofs);
+            if (d_ofs < s_ofs)
+              byte_copy (ref + d_ofs, ref + s_ofs, size);
+            else
+              {
+                size_t i;
+                for (i = size; i-- > 0; )
+                  ref[d_ofs + i] = ref[s_ofs + i];
+              }
+            ASSERT (!memcmp (dst, ref, sizeof dst));
+
+            /* memset. */
+            ASSERT (memset (dst + d_ofs, value, size) == dst + d_ofs);
+            byte_set (ref + d_ofs, value, size);
+            ASSERT (!memcmp (dst, ref, sizeof dst));
+
+            /* memcmp, with a difference in each byte in turn. */
+            memcpy (dst + d_ofs, src + s_ofs, size);
+            ASSERT (memcmp (dst + d_ofs, src + s_ofs, size) == 0);
+            if (size > 0)
+              {
+                size_t i = random_ulong () % size;
+                dst[d_ofs + i] = src[s_ofs + i] + 1;
+                ASSERT ((memcmp (dst + d_ofs, src + s_ofs, size) > 0)
+                        == (dst[d_ofs + i] > src[s_ofs + i]));
+              }
+          }
+    }
+  printf (" done\n");
+}
+
+/* Returns the time stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Prints cycles per operation of the byte loops and the library
+   functions for sizes from 16 bytes to MAX_SIZE, aligned and
+   misaligned. */
+static void
+benchmark (void)
+{
+  size_t size;
+  int misalign;
+
+  printf ("%6s %5s %10s %10s %10s %10s\n", "size", "align",
+          "byte-copy", "memcpy", "byte-set", "memset");
+  for (size = 16; size <= MAX_SIZE; size *= 2)
+    for (misalign = 0; misalign <= 1; misalign++)
+      {
+        uint8_t *d = dst + misalign;
+        const uint8_t *s = src + 3 * misalign;
+        uint64_t start, t[4];
+        int i;
+
+        start = rdtsc ();
+        for (i = 0; i < REPEAT; i++)
+          byte_copy (d, s, size);
+        t[0] = rdtsc () - start;
+
+        start = rdtsc ();
+        for (i = 0; i < REPEAT; i++)
+          memcpy (d, s, size);
+        t[1] = rdtsc () - start;
+
+        start = rdtsc ();
+        for (i = 0; i < REPEAT; i++)
+          byte_set (d, i, size);
+        t[2] = rdtsc () - start;
+
+        start = rdtsc ();
+        for (i = 0; i < REPEAT; i++)
+          memset (d, i, size);
+        t[3] = rdtsc () - start;
+
+        printf ("%6zu %5s %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64"\n",
+                size, misalign ? "no" : "yes", t[0] / REPEAT, t[1] / REPEAT,
+                t[2] / REPEAT, t[3] / REPEAT);
+      }
+}
@@ -0,0 +1,34 @@
+/* Executes a child with the most arguments the kernel accepts and
+   a command line long enough to be truncated, so that the child's
+   initial stack page is filled as far as it can be. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* 127 arguments of 27 characters each after the program name. */
+#define ARG_CNT 127
+#define ARG_LEN 27
+
+static char cmd_line[4096];
+
+void
+test_main (void) 
+{
+  char *p = cmd_line;
+  int i;
+
+  strlcpy (p, "child-simple", sizeof cmd_line);
+  p += strlen (p);
+  for (i = 0; i < ARG_CNT; i++)
+    {
+      *p++ = ' ';
+      memset (p, 'a' + i % 26, ARG_LEN);
+      p += ARG_LEN;
+    }
+  *p = '\0';
+
+  CHECK (wait (exec (cmd_line)) == 81, "wait for child with %d arguments",
+         ARG_CNT + 1);
+}
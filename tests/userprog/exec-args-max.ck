@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(exec-args-max) begin
+(exec-args-max) wait for child with 128 arguments
+(child-simple) run
+child-simple: exit(81)
+(exec-args-max) end
+exec-args-max: exit(0)
+EOF
+pass;
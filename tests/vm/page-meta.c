@@ -0,0 +1,24 @@
+/* Checks that the VM metadata reported by vm_stats() grows as the
+   process gives frames to more of its pages. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 64
+
+static char buf[PAGE_CNT * 4096];
+
+void
+test_main (void)
+{
+  int before, after;
+  size_t i;
+
+  before = vm_stats ();
+  CHECK (before > 0, "metadata before touching pages");
+  for (i = 0; i < sizeof buf; i += 4096)
+    buf[i] = 1;
+  after = vm_stats ();
+  CHECK (after > before, "metadata grows with resident pages");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-meta) begin
+(page-meta) metadata before touching pages
+(page-meta) metadata grows with resident pages
+(page-meta) end
+EOF
+pass;
@@ -38,6 +38,10 @@
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
@@ -106,6 +110,7 @@ main(void)
 #ifdef VM
     /* Initialize Frame Table */
     frame_table_init();
+    page_init();
 #endif
 
     /* Segmentation. */
@@ -122,11 +127,13 @@ main(void)
 #ifdef USERPROG
     exception_init();
     syscall_init();
+    process_init();
 #endif
 
     /* Start thread scheduler and enable interrupts. */
     thread_start();
     serial_init_queue();
+    timer_start();
     timer_calibrate();
 
 #ifdef FILESYS
@@ -271,6 +278,8 @@ parse_options(char **argv)
             random_init(atoi(value));
         } else if (!strcmp(name, "-mlfqs")) {
             thread_mlfqs = true;
+        } else if (!strcmp(name, "-tickless")) {
+            timer_tickless = true;
         }
 #ifdef USERPROG
         else if (!strcmp(name, "-ul")) {
@@ -398,6 +407,7 @@ usage(void)
 #endif
            "  -rs=SEED           Set random number seed to SEED.\n"
            "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+           "  -tickless          Stop the timer tick while idle.\n"
 #ifdef USERPROG
            "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -1,5 +1,6 @@
 #include <debug.h>
 #include <inttypes.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -9,6 +10,7 @@
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
 #include "threads/thread.h"
+#include "threads/tsc.h"
 #include "threads/vaddr.h"
 
 /* Programmable Interrupt Controller (PIC) registers.
@@ -48,6 +50,34 @@ static unsigned int unexpected_cnt[INTR_CNT];
 static bool in_external_intr; /* Are we processing an external interrupt? */
 static bool yield_on_return;  /* Should we yield on interrupt return? */
 
+/* Statistics for one interrupt vector.  Times are in time stamp
+ * counter cycles.  For an internal interrupt whose handler may
+ * sleep, such as a system call, they include the time asleep. */
+struct vec_stats {
+    unsigned long long cnt;        /* Number of interrupts. */
+    uint64_t           cycles;     /* Total time in the handler. */
+    uint64_t           max_cycles; /* Longest time in the handler. */
+};
+static struct vec_stats vec_stats[INTR_CNT];
+
+/* Interrupts-off sections, from turning interrupts off, by
+ * intr_disable() or by taking an interrupt, until turning them
+ * back on, by intr_enable() or by returning from the interrupt.
+ * OFF_START is 0 while the start of the current section is
+ * unknown, as during boot.  A section ended by the idle thread's
+ * halt is not counted. */
+static uint64_t off_start;          /* When interrupts went off. */
+static const void *off_caller;      /* Code that turned them off. */
+static unsigned long long off_cnt;  /* Number of sections. */
+static uint64_t off_cycles;         /* Total time in sections. */
+static uint64_t off_max_cycles;     /* Longest section. */
+static const void *off_max_caller;  /* Code that started the longest. */
+
+/* Softirqs.  Interrupts must be off to access these. */
+static struct list pending_softirqs = LIST_INITIALIZER(pending_softirqs);
+static struct list all_softirqs = LIST_INITIALIZER(all_softirqs);
+static bool in_softirq; /* Are we running softirqs? */
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init(void);
 
@@ -63,6 +93,12 @@ static inline uint64_t make_idtr_operand(uint16_t limit, void *base);
 /* Interrupt handlers. */
 void intr_handler(struct intr_frame *args);
 static void unexpected_interrupt(const struct intr_frame *);
+static void run_softirqs(void);
+
+/* Interrupts-off accounting. */
+static enum intr_level disable(const void *caller);
+static void off_begin(const void *caller);
+static void off_end(void);
 
 /* Returns the current interrupt status. */
 enum intr_level
@@ -84,7 +120,8 @@ intr_get_level(void)
 enum intr_level
 intr_set_level(enum intr_level level)
 {
-    return level == INTR_ON ? intr_enable() : intr_disable();
+    return level == INTR_ON ? intr_enable()
+                            : disable(__builtin_return_address(0));
 }
 
 /* Enables interrupts and returns the previous interrupt status. */
@@ -95,6 +132,10 @@ intr_enable(void)
 
     ASSERT(!intr_context());
 
+    if (old_level == INTR_OFF) {
+        off_end();
+    }
+
     /* Enable interrupts by setting the interrupt flag.
      *
      * See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -107,6 +148,14 @@ intr_enable(void)
 /* Disables interrupts and returns the previous interrupt status. */
 enum intr_level
 intr_disable(void)
+{
+    return disable(__builtin_return_address(0));
+}
+
+/* Disables interrupts on behalf of CALLER and returns the
+ * previous interrupt status. */
+static enum intr_level
+disable(const void *caller)
 {
     enum intr_level old_level = intr_get_level();
 
@@ -115,9 +164,38 @@ intr_disable(void)
      * Hardware Interrupts". */
     asm volatile ("cli" : : : "memory");
 
+    if (old_level == INTR_ON) {
+        off_begin(caller);
+    }
     return old_level;
 }
 
+/* Notes that CALLER has just turned interrupts off. */
+static void
+off_begin(const void *caller)
+{
+    off_start = rdtsc();
+    off_caller = caller;
+}
+
+/* Notes that interrupts are about to be turned back on, and
+ * accounts for the section that is ending. */
+static void
+off_end(void)
+{
+    if (off_start != 0) {
+        uint64_t cycles = rdtsc() - off_start;
+
+        off_cnt++;
+        off_cycles += cycles;
+        if (cycles > off_max_cycles) {
+            off_max_cycles = cycles;
+            off_max_caller = off_caller;
+        }
+        off_start = 0;
+    }
+}
+
 /* Initializes the interrupt system. */
 void
 intr_init(void)
@@ -222,14 +300,14 @@ intr_context(void)
     return in_external_intr;
 }
 
-/* During processing of an external interrupt, directs the
- * interrupt handler to yield to a new process just before
- * returning from the interrupt.  May not be called at any other
- * time. */
+/* During processing of an external interrupt or a softirq,
+ * directs the interrupt handler to yield to a new process just
+ * before returning from the interrupt.  May not be called at any
+ * other time. */
 void
 intr_yield_on_return(void)
 {
-    ASSERT(intr_context());
+    ASSERT(intr_context() || softirq_context());
     yield_on_return = true;
 }
 
@@ -355,6 +433,18 @@ intr_handler(struct intr_frame *frame)
 {
     bool external;
     intr_handler_func *handler;
+    struct vec_stats *stats = &vec_stats[frame->vec_no];
+    bool was_on = (frame->eflags & FLAG_IF) != 0;
+    uint64_t start;
+    uint64_t cycles;
+
+    /* An interrupt gate turned interrupts off on the way in. */
+    handler = intr_handlers[frame->vec_no];
+    if (was_on && intr_get_level() == INTR_OFF) {
+        off_begin(handler);
+    }
+    stats->cnt++;
+    start = rdtsc();
 
     /* External interrupts are special.
      * We only handle one at a time (so interrupts must be off)
@@ -366,11 +456,12 @@ intr_handler(struct intr_frame *frame)
         ASSERT(!intr_context());
 
         in_external_intr = true;
-        yield_on_return = false;
+        if (!in_softirq) {
+            yield_on_return = false;
+        }
     }
 
     /* Invoke the interrupt's handler. */
-    handler = intr_handlers[frame->vec_no];
     if (handler != NULL) {
         handler(frame);
     } else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f) {
@@ -381,6 +472,12 @@ intr_handler(struct intr_frame *frame)
         unexpected_interrupt(frame);
     }
 
+    cycles = rdtsc() - start;
+    stats->cycles += cycles;
+    if (cycles > stats->max_cycles) {
+        stats->max_cycles = cycles;
+    }
+
     /* Complete the processing of an external interrupt. */
     if (external) {
         ASSERT(intr_get_level() == INTR_OFF);
@@ -389,10 +486,180 @@ intr_handler(struct intr_frame *frame)
         in_external_intr = false;
         pic_end_of_interrupt(frame->vec_no);
 
-        if (yield_on_return) {
-            thread_yield();
+        /* If we interrupted softirqs, leave the rest, including
+         * any yield, to the interrupt that started them. */
+        if (!in_softirq) {
+            run_softirqs();
+
+            if (yield_on_return) {
+                thread_yield();
+            }
         }
     }
+
+    /* Returning from the interrupt will turn interrupts back on. */
+    if (was_on && intr_get_level() == INTR_OFF) {
+        off_end();
+    }
+}
+
+/* Runs the pending softirqs, and any that they or interrupts
+ * raise meanwhile, with interrupts on.  Called with interrupts
+ * off at the end of an external interrupt. */
+static void
+run_softirqs(void)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    in_softirq = true;
+    while (!list_empty(&pending_softirqs)) {
+        struct softirq *s = list_entry(list_pop_front(&pending_softirqs),
+                                       struct softirq, pending_elem);
+        uint64_t start;
+
+        s->pending = false;
+        intr_enable();
+        start = rdtsc();
+        s->func(s->aux);
+        intr_disable();
+        s->cycles += rdtsc() - start;
+        s->runs++;
+    }
+    in_softirq = false;
+}
+
+/* Initializes softirq S to run FUNC with auxiliary data AUX.
+ * NAME identifies it in statistics. */
+void
+softirq_init(struct softirq *s, const char *name, softirq_func *func,
+             void *aux)
+{
+    enum intr_level old_level;
+
+    ASSERT(func != NULL);
+
+    s->name = name;
+    s->func = func;
+    s->aux = aux;
+    s->pending = false;
+    s->runs = 0;
+    s->cycles = 0;
+
+    old_level = intr_disable();
+    list_push_back(&all_softirqs, &s->all_elem);
+    intr_set_level(old_level);
+}
+
+/* Arranges for softirq S to run when the current external
+ * interrupt returns, or at the end of the next one if called
+ * outside an interrupt.  Does nothing if S is already pending.
+ * Interrupts must be off. */
+void
+softirq_raise(struct softirq *s)
+{
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (!s->pending) {
+        s->pending = true;
+        list_push_back(&pending_softirqs, &s->pending_elem);
+    }
+}
+
+/* Returns true while softirqs are running, false otherwise. */
+bool
+softirq_context(void)
+{
+    return in_softirq;
+}
+
+/* Where a statistics report goes: the console if BUF is null,
+ * otherwise the SIZE bytes at BUF, of which LEN have been used. */
+struct report {
+    char  *buf;
+    size_t size;
+    size_t len;
+};
+
+/* Adds a line to report R, formatted as by printf(). */
+static void PRINTF_FORMAT(2, 3)
+report_line(struct report *r, const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    if (r->buf == NULL) {
+        vprintf(format, args);
+    } else if (r->len < r->size) {
+        int n = vsnprintf(r->buf + r->len, r->size - r->len, format, args);
+
+        r->len += n;
+        if (r->len >= r->size) {
+            r->len = r->size - 1;
+        }
+    }
+    va_end(args);
+}
+
+/* Reports the count and handler time of each interrupt vector
+ * that has fired, the time spent in each softirq, and the time
+ * spent with interrupts off, to R. */
+static void
+report_stats(struct report *r)
+{
+    struct list_elem *e;
+    int vec;
+
+    for (vec = 0; vec < INTR_CNT; vec++) {
+        const struct vec_stats *stats = &vec_stats[vec];
+
+        if (stats->cnt != 0) {
+            report_line(r, "Interrupt %#04x (%s): %llu times, "
+                        "avg %"PRIu64" max %"PRIu64" cycles\n",
+                        vec, intr_names[vec], stats->cnt,
+                        stats->cycles / stats->cnt, stats->max_cycles);
+        }
+    }
+    for (e = list_begin(&all_softirqs); e != list_end(&all_softirqs);
+         e = list_next(e)) {
+        struct softirq *s = list_entry(e, struct softirq, all_elem);
+
+        if (s->runs != 0) {
+            report_line(r, "Softirq %s: %llu runs, %"PRIu64" cycles\n",
+                        s->name, s->runs, s->cycles);
+        }
+    }
+    if (off_cnt != 0) {
+        report_line(r, "Interrupts off: %llu times, avg %"PRIu64" max %"
+                    PRIu64" cycles, longest from %p\n", off_cnt,
+                    off_cycles / off_cnt, off_max_cycles, off_max_caller);
+    }
+}
+
+/* Prints interrupt statistics. */
+void
+intr_print_stats(void)
+{
+    struct report r = { NULL, 0, 0 };
+
+    report_stats(&r);
+}
+
+/* Formats the same statistics as intr_print_stats() into the
+ * SIZE bytes at BUF, which are null-terminated if SIZE is
+ * nonzero, and returns the number of characters written, not
+ * counting the null terminator.  Output that does not fit is
+ * dropped. */
+size_t
+intr_format_stats(char *buf, size_t size)
+{
+    struct report r = { buf, size, 0 };
+
+    if (size == 0) {
+        return 0;
+    }
+    buf[0] = '\0';
+    report_stats(&r);
+    return r.len;
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
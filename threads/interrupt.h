@@ -1,7 +1,9 @@
 #ifndef THREADS_INTERRUPT_H
 #define THREADS_INTERRUPT_H
 
+#include <list.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* Interrupts on or off? */
@@ -63,5 +65,47 @@ bool intr_context(void);
 void intr_yield_on_return(void);
 void intr_dump_frame(const struct intr_frame *);
 const char *intr_name(uint8_t vec);
+void intr_print_stats(void);
+size_t intr_format_stats(char *, size_t size);
+
+/* Deferred interrupt work ("soft interrupts").
+ *
+ * An external interrupt handler that has more to do than talk to
+ * its device can raise a softirq for the rest.  Raised softirqs
+ * run just before the interrupt returns, after the PIC has been
+ * acknowledged, with interrupts turned back on, so that other
+ * interrupts are not held off meanwhile.  Each runs once however
+ * many times it was raised.
+ *
+ * A softirq function runs on the stack of whatever thread was
+ * interrupted, so like an interrupt handler it must not sleep,
+ * and data it shares with threads must be protected by turning
+ * interrupts off.  It may call intr_yield_on_return().  Softirqs
+ * never run concurrently with one another.
+ *
+ * Because interrupts are on, intr_context() is false while a
+ * softirq runs; use softirq_context() to tell.  sema_down(),
+ * lock_acquire(), and cond_wait() assert that it is false: a
+ * softirq may wake threads, with sema_up() or thread_unblock(),
+ * but never wait for one. */
+
+typedef void softirq_func(void *aux);
+
+/* A softirq. */
+struct softirq {
+    struct list_elem pending_elem; /* Element in the pending list. */
+    struct list_elem all_elem;     /* Element in the list of softirqs. */
+    const char      *name;         /* Name, for statistics. */
+    softirq_func    *func;         /* Function to run. */
+    void            *aux;          /* Auxiliary data for `func'. */
+    bool             pending;      /* Raised but not yet run? */
+    unsigned long long runs;       /* Number of times run. */
+    uint64_t         cycles;       /* Total time spent running. */
+};
+
+void softirq_init(struct softirq *, const char *name, softirq_func *,
+                  void *aux);
+void softirq_raise(struct softirq *);
+bool softirq_context(void);
 
 #endif /* threads/interrupt.h */
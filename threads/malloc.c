@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
@@ -25,9 +26,31 @@
  * list.  Then we return one of the new blocks.
  *
  * When we free a block, we add it to its descriptor's free list.
- * But if the arena that the block was in now has no in-use
- * blocks, we remove all of the arena's blocks from the free list
- * and give the arena back to the page allocator.
+ * If the arena that the block was in now has no in-use blocks,
+ * it becomes a "spare".  Each descriptor keeps up to
+ * ARENA_SPARES spare arenas; beyond that, we remove all of the
+ * arena's blocks from the free list and give the arena back to
+ * the page allocator.  Keeping a couple of spares stops a
+ * malloc()/free() pair at an arena boundary from getting and
+ * freeing a page every time.
+ *
+ * In front of the free list, each descriptor has a "magazine", a
+ * small stack of ready blocks.  malloc() and free() go through
+ * the magazine with interrupts briefly disabled and only take the
+ * descriptor's lock to refill it from, or flush it to, the free
+ * list MAG_BATCH blocks at a time.  (Pintos has one CPU, so a
+ * per-descriptor magazine is what a per-CPU magazine would be on
+ * a multiprocessor.)
+ *
+ * kmem_cache_create() makes a descriptor for one fixed-size
+ * object type, so that hot structures get blocks of exactly
+ * their size instead of the next power of 2.  A cache may have a
+ * constructor, which runs once on each object when its arena is
+ * created rather than on every allocation: objects must be
+ * freed back in their constructed state, and come out of
+ * kmem_cache_alloc() that way.  To keep that state intact, the
+ * free list element of such a cache lives just past the object
+ * instead of over its first bytes.
  *
  * We can't handle blocks bigger than 2 kB using this scheme,
  * because they're too big to fit in a single page with a
@@ -35,12 +58,38 @@
  * with the page allocator and sticking the allocation size at
  * the beginning of the allocated block's arena header. */
 
+/* Number of blocks a magazine holds. */
+#define MAG_SIZE 16
+
+/* Number of blocks moved between a magazine and its free list
+ * at a time. */
+#define MAG_BATCH (MAG_SIZE / 2)
+
+/* Number of empty arenas a descriptor keeps before giving them
+ * back to the page allocator. */
+#define ARENA_SPARES 2
+
 /* Descriptor. */
 struct desc {
-    size_t      block_size;       /* Size of each element in bytes. */
-    size_t      blocks_per_arena; /* Number of blocks in an arena. */
-    struct list free_list;        /* List of free blocks. */
-    struct lock lock;             /* Lock. */
+    size_t        block_size;       /* Size of each element in bytes. */
+    size_t        blocks_per_arena; /* Number of blocks in an arena. */
+    size_t        link_ofs;         /* Offset of free_elem in a block. */
+    kmem_ctor_func *ctor;           /* Object constructor, or null. */
+    struct list   free_list;        /* List of free blocks. */
+    struct lock   lock;             /* Lock. */
+    size_t        spare_cnt;        /* Arenas with no blocks in use. */
+    struct block *mag[MAG_SIZE];    /* Magazine of ready blocks. */
+    size_t        mag_cnt;          /* Number of blocks in mag[]. */
+};
+
+/* Object cache: a descriptor for a single object type. */
+struct kmem_cache {
+    struct desc desc;               /* Descriptor for the objects. */
+    const char *name;               /* Name, for debugging. */
+    size_t      obj_size;           /* Requested object size. */
+    size_t      in_use;             /* Objects handed out. */
+    size_t      peak;               /* Maximum of in_use. */
+    struct list_elem elem;          /* Element in cache_list. */
 };
 
 /* Magic number for detecting arena corruption. */
@@ -53,7 +102,9 @@ struct arena {
     size_t       free_cnt; /* Free blocks; pages in big block. */
 };
 
-/* Free block. */
+/* Free block.  The free list element is at the block's
+ * descriptor's link_ofs, which is 0 except in caches with a
+ * constructor. */
 struct block {
     struct list_elem free_elem; /* Free list element. */
 };
@@ -62,6 +113,16 @@ struct block {
 static struct desc descs[10]; /* Descriptors. */
 static size_t desc_cnt;       /* Number of descriptors. */
 
+/* All object caches, for statistics. */
+static struct list cache_list;
+
+static void desc_init(struct desc *, size_t block_size, size_t link_ofs,
+                      kmem_ctor_func *);
+static void *desc_alloc(struct desc *);
+static void desc_free(struct desc *, struct block *);
+static size_t desc_alloc_multiple(struct desc *, void **, size_t cnt);
+static void desc_free_multiple(struct desc *, void **, size_t cnt);
+static void kmem_cache_count(struct kmem_cache *, int delta);
 static struct arena *block_to_arena(struct block *);
 static struct block *arena_to_block(struct arena *, size_t idx);
 
@@ -74,11 +135,9 @@ malloc_init(void)
     for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2) {
         struct desc *d = &descs[desc_cnt++];
         ASSERT(desc_cnt <= sizeof descs / sizeof *descs);
-        d->block_size = block_size;
-        d->blocks_per_arena = (PGSIZE - sizeof(struct arena)) / block_size;
-        list_init(&d->free_list);
-        lock_init(&d->lock);
+        desc_init(d, block_size, 0, NULL);
     }
+    list_init(&cache_list);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -87,7 +146,6 @@ void *
 malloc(size_t size)
 {
     struct desc *d;
-    struct block *b;
     struct arena *a;
 
     /* A null pointer satisfies a request for 0 bytes. */
@@ -119,35 +177,7 @@ malloc(size_t size)
         return a + 1;
     }
 
-    lock_acquire(&d->lock);
-
-    /* If the free list is empty, create a new arena. */
-    if (list_empty(&d->free_list)) {
-        size_t i;
-
-        /* Allocate a page. */
-        a = palloc_get_page(0);
-        if (a == NULL) {
-            lock_release(&d->lock);
-            return NULL;
-        }
-
-        /* Initialize arena and add its blocks to the free list. */
-        a->magic = ARENA_MAGIC;
-        a->desc = d;
-        a->free_cnt = d->blocks_per_arena;
-        for (i = 0; i < d->blocks_per_arena; i++) {
-            struct block *b = arena_to_block(a, i);
-            list_push_back(&d->free_list, &b->free_elem);
-        }
-    }
-
-    /* Get a block from free list and return it. */
-    b = list_entry(list_pop_front(&d->free_list), struct block, free_elem);
-    a = block_to_arena(b);
-    a->free_cnt--;
-    lock_release(&d->lock);
-    return b;
+    return desc_alloc(d);
 }
 
 /* Allocates and return A times B bytes initialized to zeroes.
@@ -223,32 +253,376 @@ free(void *p)
 
 #ifndef NDEBUG
             /* Clear the block to help detect use-after-free bugs. */
-            memset(b, 0xcc, d->block_size);
+            if (d->ctor == NULL) {
+                memset(b, 0xcc, d->block_size);
+            }
+#endif
+
+            desc_free(d, b);
+        } else {
+            /* It's a big block.  Free its pages. */
+            palloc_free_multiple(a, a->free_cnt);
+            return;
+        }
+    }
+}
+
+/* Creates and returns a cache of objects of SIZE bytes named
+ * NAME, or a null pointer if memory is not available.  SIZE
+ * must be at most half a page.  If CTOR is nonnull, it is called
+ * on each object once, when the object's arena is created, and
+ * objects must be freed in the state that CTOR leaves them in. */
+struct kmem_cache *
+kmem_cache_create(const char *name, size_t size, kmem_ctor_func *ctor)
+{
+    struct kmem_cache *c;
+    size_t link_ofs, block_size;
+
+    ASSERT(size > 0 && size <= PGSIZE / 2);
+
+    c = malloc(sizeof *c);
+    if (c == NULL) {
+        return NULL;
+    }
+    if (ctor != NULL) {
+        link_ofs = ROUND_UP(size, sizeof(void *));
+        block_size = link_ofs + sizeof(struct block);
+    } else {
+        link_ofs = 0;
+        block_size = size < sizeof(struct block) ? sizeof(struct block) : size;
+    }
+    desc_init(&c->desc, ROUND_UP(block_size, sizeof(uint64_t)), link_ofs, ctor);
+    c->name = name;
+    c->obj_size = size;
+    c->in_use = c->peak = 0;
+    list_push_back(&cache_list, &c->elem);
+    return c;
+}
+
+/* Obtains and returns an object from cache C, or a null pointer
+ * if memory is not available. */
+void *
+kmem_cache_alloc(struct kmem_cache *c)
+{
+    void *p = desc_alloc(&c->desc);
+
+    if (p != NULL) {
+        kmem_cache_count(c, 1);
+    }
+    return p;
+}
+
+/* Returns object P, which must have come from cache C, to C. */
+void
+kmem_cache_free(struct kmem_cache *c, void *p)
+{
+    if (p != NULL) {
+        struct block *b = p;
+
+        ASSERT(block_to_arena(b)->desc == &c->desc);
+#ifndef NDEBUG
+        if (c->desc.ctor == NULL) {
+            memset(b, 0xcc, c->desc.block_size);
+        }
+#endif
+        kmem_cache_count(c, -1);
+        desc_free(&c->desc, b);
+    }
+}
+
+/* Obtains CNT objects from cache C and stores them in OBJS,
+ * taking C's lock at most once.  Returns the number of objects
+ * obtained, which is less than CNT only if memory ran out. */
+size_t
+kmem_cache_alloc_multiple(struct kmem_cache *c, void **objs, size_t cnt)
+{
+    size_t got = desc_alloc_multiple(&c->desc, objs, cnt);
+
+    kmem_cache_count(c, got);
+    return got;
+}
+
+/* Returns the CNT objects in OBJS, which must have come from
+ * cache C, to C, taking C's lock at most once. */
+void
+kmem_cache_free_multiple(struct kmem_cache *c, void **objs, size_t cnt)
+{
+    size_t i;
+
+    for (i = 0; i < cnt; i++) {
+        ASSERT(block_to_arena(objs[i])->desc == &c->desc);
+#ifndef NDEBUG
+        if (c->desc.ctor == NULL) {
+            memset(objs[i], 0xcc, c->desc.block_size);
+        }
 #endif
+    }
+    kmem_cache_count(c, -(int) cnt);
+    desc_free_multiple(&c->desc, objs, cnt);
+}
+
+/* Returns the number of bytes that each object in C occupies,
+ * including its share of the free list link. */
+size_t
+kmem_cache_obj_size(const struct kmem_cache *c)
+{
+    return c->desc.block_size;
+}
+
+/* Prints the number of objects in use in each cache. */
+void
+kmem_cache_print_stats(void)
+{
+    struct list_elem *e;
+
+    for (e = list_begin(&cache_list); e != list_end(&cache_list);
+         e = list_next(e)) {
+        struct kmem_cache *c = list_entry(e, struct kmem_cache, elem);
+
+        printf("Cache %s: %zu objects of %zu bytes in use, %zu peak\n",
+               c->name, c->in_use, c->desc.block_size, c->peak);
+    }
+}
+
+/* Adds DELTA to the count of objects in use in C. */
+static void
+kmem_cache_count(struct kmem_cache *c, int delta)
+{
+    enum intr_level old_level = intr_disable();
+
+    c->in_use += delta;
+    if (c->in_use > c->peak) {
+        c->peak = c->in_use;
+    }
+    intr_set_level(old_level);
+}
 
-            lock_acquire(&d->lock);
+/* Initializes descriptor D for blocks of BLOCK_SIZE bytes, with
+ * their free list element LINK_OFS bytes in and constructor CTOR
+ * (which may be null). */
+static void
+desc_init(struct desc *d, size_t block_size, size_t link_ofs,
+          kmem_ctor_func *ctor)
+{
+    d->block_size = block_size;
+    d->blocks_per_arena = (PGSIZE - sizeof(struct arena)) / block_size;
+    d->link_ofs = link_ofs;
+    d->ctor = ctor;
+    list_init(&d->free_list);
+    lock_init(&d->lock);
+    d->spare_cnt = 0;
+    d->mag_cnt = 0;
+}
+
+/* Returns block B's free list element in D. */
+static struct list_elem *
+block_elem(const struct desc *d, struct block *b)
+{
+    return &((struct block *) ((uint8_t *) b + d->link_ofs))->free_elem;
+}
 
-            /* Add block to free list. */
-            list_push_front(&d->free_list, &b->free_elem);
+/* Returns the block whose free list element in D is E. */
+static struct block *
+elem_block(const struct desc *d, struct list_elem *e)
+{
+    return (struct block *) ((uint8_t *) list_entry(e, struct block, free_elem)
+                             - d->link_ofs);
+}
+
+/* Takes a block off D's free list, creating a new arena if the
+ * list is empty.  Returns a null pointer if memory is not
+ * available.  D's lock must be held. */
+static struct block *
+desc_take(struct desc *d)
+{
+    struct block *b;
+    struct arena *a;
+
+    ASSERT(lock_held_by_current_thread(&d->lock));
+
+    /* If the free list is empty, create a new arena. */
+    if (list_empty(&d->free_list)) {
+        size_t i;
 
-            /* If the arena is now entirely unused, free it. */
-            if (++a->free_cnt >= d->blocks_per_arena) {
-                size_t i;
+        /* Allocate a page. */
+        a = palloc_get_page(0);
+        if (a == NULL) {
+            return NULL;
+        }
 
-                ASSERT(a->free_cnt == d->blocks_per_arena);
-                for (i = 0; i < d->blocks_per_arena; i++) {
-                    struct block *b = arena_to_block(a, i);
-                    list_remove(&b->free_elem);
-                }
-                palloc_free_page(a);
+        /* Initialize arena and add its blocks to the free list. */
+        a->magic = ARENA_MAGIC;
+        a->desc = d;
+        a->free_cnt = d->blocks_per_arena;
+        for (i = 0; i < d->blocks_per_arena; i++) {
+            struct block *b = arena_to_block(a, i);
+            if (d->ctor != NULL) {
+                d->ctor(b);
             }
+            list_push_back(&d->free_list, block_elem(d, b));
+        }
+        d->spare_cnt++;
+    }
+
+    /* Get a block from free list. */
+    b = elem_block(d, list_pop_front(&d->free_list));
+    a = block_to_arena(b);
+    if (a->free_cnt-- == d->blocks_per_arena) {
+        d->spare_cnt--;
+    }
+    return b;
+}
+
+/* Puts block B back on D's free list, giving its arena back to
+ * the page allocator if that leaves D with too many spare
+ * arenas.  D's lock must be held. */
+static void
+desc_put(struct desc *d, struct block *b)
+{
+    struct arena *a = block_to_arena(b);
+
+    ASSERT(lock_held_by_current_thread(&d->lock));
 
-            lock_release(&d->lock);
+    /* Add block to free list. */
+    list_push_front(&d->free_list, block_elem(d, b));
+
+    /* If the arena is now entirely unused, keep it as a spare or
+     * free it. */
+    if (++a->free_cnt >= d->blocks_per_arena) {
+        ASSERT(a->free_cnt == d->blocks_per_arena);
+        if (d->spare_cnt < ARENA_SPARES) {
+            d->spare_cnt++;
         } else {
-            /* It's a big block.  Free its pages. */
-            palloc_free_multiple(a, a->free_cnt);
-            return;
+            size_t i;
+
+            for (i = 0; i < d->blocks_per_arena; i++) {
+                struct block *b = arena_to_block(a, i);
+                list_remove(block_elem(d, b));
+            }
+            palloc_free_page(a);
+        }
+    }
+}
+
+/* Obtains and returns a block from D, or a null pointer if
+ * memory is not available. */
+static void *
+desc_alloc(struct desc *d)
+{
+    struct block *b = NULL;
+    enum intr_level old_level;
+    size_t i;
+
+    /* Fast path: take a block from the magazine. */
+    old_level = intr_disable();
+    if (d->mag_cnt > 0) {
+        b = d->mag[--d->mag_cnt];
+    }
+    intr_set_level(old_level);
+    if (b != NULL) {
+        return b;
+    }
+
+    /* Slow path: take a block from the free list, and refill the
+     * magazine from blocks that are already there. */
+    lock_acquire(&d->lock);
+    b = desc_take(d);
+    if (b != NULL) {
+        for (i = 0; i < MAG_BATCH && !list_empty(&d->free_list); i++) {
+            old_level = intr_disable();
+            if (d->mag_cnt < MAG_SIZE) {
+                d->mag[d->mag_cnt++] = desc_take(d);
+            }
+            intr_set_level(old_level);
+        }
+    }
+    lock_release(&d->lock);
+    return b;
+}
+
+/* Returns block B to D. */
+static void
+desc_free(struct desc *d, struct block *b)
+{
+    enum intr_level old_level;
+    size_t i;
+
+    /* Fast path: put the block in the magazine. */
+    old_level = intr_disable();
+    if (d->mag_cnt < MAG_SIZE) {
+        d->mag[d->mag_cnt++] = b;
+        b = NULL;
+    }
+    intr_set_level(old_level);
+    if (b == NULL) {
+        return;
+    }
+
+    /* Slow path: the magazine is full.  Return this block and
+     * half of the magazine to the free list. */
+    lock_acquire(&d->lock);
+    desc_put(d, b);
+    for (i = 0; i < MAG_BATCH; i++) {
+        old_level = intr_disable();
+        b = d->mag_cnt > 0 ? d->mag[--d->mag_cnt] : NULL;
+        intr_set_level(old_level);
+        if (b == NULL) {
+            break;
+        }
+        desc_put(d, b);
+    }
+    lock_release(&d->lock);
+}
+
+/* Obtains up to CNT blocks from D into BLOCKS, emptying the
+ * magazine first and taking D's lock at most once.  Returns the
+ * number of blocks obtained. */
+static size_t
+desc_alloc_multiple(struct desc *d, void **blocks, size_t cnt)
+{
+    enum intr_level old_level;
+    size_t got = 0;
+
+    old_level = intr_disable();
+    while (got < cnt && d->mag_cnt > 0) {
+        blocks[got++] = d->mag[--d->mag_cnt];
+    }
+    intr_set_level(old_level);
+
+    if (got < cnt) {
+        lock_acquire(&d->lock);
+        while (got < cnt) {
+            struct block *b = desc_take(d);
+            if (b == NULL) {
+                break;
+            }
+            blocks[got++] = b;
+        }
+        lock_release(&d->lock);
+    }
+    return got;
+}
+
+/* Returns the CNT blocks in BLOCKS to D, filling the magazine
+ * first and taking D's lock at most once. */
+static void
+desc_free_multiple(struct desc *d, void **blocks, size_t cnt)
+{
+    enum intr_level old_level;
+    size_t i = 0;
+
+    old_level = intr_disable();
+    while (i < cnt && d->mag_cnt < MAG_SIZE) {
+        d->mag[d->mag_cnt++] = blocks[i++];
+    }
+    intr_set_level(old_level);
+
+    if (i < cnt) {
+        lock_acquire(&d->lock);
+        while (i < cnt) {
+            desc_put(d, blocks[i++]);
         }
+        lock_release(&d->lock);
     }
 }
 
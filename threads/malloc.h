@@ -10,4 +10,15 @@ void *calloc(size_t, size_t) __attribute__ ((malloc));
 void *realloc(void *, size_t);
 void free(void *);
 
+/* Caches of fixed-size objects. */
+typedef void kmem_ctor_func(void *obj);
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+                                     kmem_ctor_func *);
+void *kmem_cache_alloc(struct kmem_cache *);
+void kmem_cache_free(struct kmem_cache *, void *);
+size_t kmem_cache_alloc_multiple(struct kmem_cache *, void **objs, size_t cnt);
+void kmem_cache_free_multiple(struct kmem_cache *, void **objs, size_t cnt);
+size_t kmem_cache_obj_size(const struct kmem_cache *);
+void kmem_cache_print_stats(void);
+
 #endif /* threads/malloc.h */
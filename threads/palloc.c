@@ -1,15 +1,17 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/palloc.h"
-#include "threads/synch.h"
+#include "threads/tsc.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -24,19 +26,63 @@
  *
  * By default, half of system RAM is given to the kernel pool and
  * half to the user pool.  That should be huge overkill for the
- * kernel pool, but that's just fine for demonstration purposes. */
+ * kernel pool, but that's just fine for demonstration purposes.
+ *
+ * Within a pool, free pages are managed by a binary buddy
+ * allocator.  Every free block is 2**ORDER pages long, starts at
+ * a page index that is a multiple of its length, and sits on the
+ * free list for its order.  An allocation takes a block from the
+ * smallest non-empty list that fits, splitting off buddies as it
+ * goes; a free merges the block with its buddy for as long as the
+ * buddy is also free.  Both are O(log n) in the pool size.
+ * Requests that are not a power of two get a rounded-up block
+ * whose unused tail is handed straight back, so a request never
+ * holds more pages than it asked for. */
+
+/* Largest block order.  Requests for more than 2**PALLOC_MAX_ORDER
+ * pages (4 MB) always fail. */
+#define PALLOC_MAX_ORDER 10
+
+/* Marks a page that does not start a free block. */
+#define NOT_FREE 0xff
+
+/* Header kept in the first page of each free block. */
+struct free_block {
+    struct list_elem elem; /* Element in pool's free_lists[]. */
+};
 
-/* A memory pool. */
+/* Allocation statistics for a pool. */
+struct pool_stats {
+    long long alloc_cnt;      /* Successful allocations. */
+    long long fail_cnt;       /* Failed allocations. */
+    long long free_cnt;       /* Calls to free. */
+    uint64_t  alloc_cycles;   /* Total cycles spent allocating. */
+    uint64_t  max_cycles;     /* Slowest single allocation. */
+};
+
+/* A memory pool.  Its free lists are also manipulated by
+ * palloc_free_page() from thread_schedule_tail(), where
+ * interrupts are off and we must not sleep on a lock, so the
+ * (short) critical sections disable interrupts instead. */
 struct pool {
-    struct lock    lock;     /* Mutual exclusion. */
-    struct bitmap *used_map; /* Bitmap of free pages. */
-    uint8_t       *base;     /* Base of pool. */
+    const char    *name;       /* Name, for statistics. */
+    struct bitmap *used_map;   /* Bitmap of allocated pages. */
+    uint8_t       *base;       /* Base of pool. */
+    size_t         page_cnt;   /* Number of pages in pool. */
+    size_t         free_pages; /* Number of free pages. */
+    uint8_t       *free_order; /* Order of free block at each page. */
+    struct list    free_lists[PALLOC_MAX_ORDER + 1]; /* Free blocks. */
+    size_t         block_cnt[PALLOC_MAX_ORDER + 1];  /* List lengths. */
+    struct pool_stats stats;   /* Allocation statistics. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
 static void init_pool(struct pool *, void *base, size_t page_cnt, const char *name);
+static size_t pool_alloc(struct pool *, size_t page_cnt);
+static void pool_free(struct pool *, size_t page_idx, size_t page_cnt);
+static void print_pool_stats(const struct pool *);
 
 static bool page_from_pool(const struct pool *, void *page);
 
@@ -75,14 +121,27 @@ palloc_get_multiple(enum palloc_flags flags, size_t page_cnt)
     struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
     void *pages;
     size_t page_idx;
+    enum intr_level old_level;
+    uint64_t start, cycles;
 
     if (page_cnt == 0) {
         return NULL;
     }
 
-    lock_acquire(&pool->lock);
-    page_idx = bitmap_scan_and_flip(pool->used_map, 0, page_cnt, false);
-    lock_release(&pool->lock);
+    old_level = intr_disable();
+    start = rdtsc();
+    page_idx = pool_alloc(pool, page_cnt);
+    cycles = rdtsc() - start;
+    if (page_idx != BITMAP_ERROR) {
+        pool->stats.alloc_cnt++;
+        pool->stats.alloc_cycles += cycles;
+        if (cycles > pool->stats.max_cycles) {
+            pool->stats.max_cycles = cycles;
+        }
+    } else {
+        pool->stats.fail_cnt++;
+    }
+    intr_set_level(old_level);
 
     if (page_idx != BITMAP_ERROR) {
         pages = pool->base + PGSIZE * page_idx;
@@ -122,6 +181,7 @@ palloc_free_multiple(void *pages, size_t page_cnt)
 {
     struct pool *pool;
     size_t page_idx;
+    enum intr_level old_level;
 
     ASSERT(pg_ofs(pages) == 0);
     if (pages == NULL || page_cnt == 0) {
@@ -142,8 +202,11 @@ palloc_free_multiple(void *pages, size_t page_cnt)
     memset(pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+    old_level = intr_disable();
     ASSERT(bitmap_all(pool->used_map, page_idx, page_cnt));
-    bitmap_set_multiple(pool->used_map, page_idx, page_cnt, false);
+    pool_free(pool, page_idx, page_cnt);
+    pool->stats.free_cnt++;
+    intr_set_level(old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -153,15 +216,25 @@ palloc_free_page(void *page)
     palloc_free_multiple(page, 1);
 }
 
+/* Prints page allocator statistics. */
+void
+palloc_print_stats(void)
+{
+    print_pool_stats(&kernel_pool);
+    print_pool_stats(&user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END,
  * naming it NAME for debugging purposes. */
 static void
 init_pool(struct pool *p, void *base, size_t page_cnt, const char *name)
 {
-    /* We'll put the pool's used_map at its base.
-     * Calculate the space needed for the bitmap
-     * and subtract it from the pool's size. */
-    size_t bm_pages = DIV_ROUND_UP(bitmap_buf_size(page_cnt), PGSIZE);
+    /* We'll put the pool's used_map and free_order array at its
+     * base.  Calculate the space needed for them and subtract it
+     * from the pool's size. */
+    size_t bm_size = ROUND_UP(bitmap_buf_size(page_cnt), sizeof(long));
+    size_t bm_pages = DIV_ROUND_UP(bm_size + page_cnt, PGSIZE);
+    int order;
 
     if (bm_pages > page_cnt) {
         PANIC("Not enough memory in %s for bitmap.", name);
@@ -171,9 +244,183 @@ init_pool(struct pool *p, void *base, size_t page_cnt, const char *name)
     printf("%zu pages available in %s.\n", page_cnt, name);
 
     /* Initialize the pool. */
-    lock_init(&p->lock);
-    p->used_map = bitmap_create_in_buf(page_cnt, base, bm_pages * PGSIZE);
+    p->name = name;
+    p->used_map = bitmap_create_in_buf(page_cnt, base, bm_size);
+    p->free_order = (uint8_t *) base + bm_size;
     p->base = base + bm_pages * PGSIZE;
+    p->page_cnt = page_cnt;
+    p->free_pages = 0;
+    for (order = 0; order <= PALLOC_MAX_ORDER; order++) {
+        list_init(&p->free_lists[order]);
+        p->block_cnt[order] = 0;
+    }
+    memset(p->free_order, NOT_FREE, page_cnt);
+    memset(&p->stats, 0, sizeof p->stats);
+
+    /* Hand every page to the buddy allocator.  The pages are not
+     * marked in used_map, so go through the free path's inner
+     * half directly. */
+    bitmap_set_all(p->used_map, true);
+    pool_free(p, 0, page_cnt);
+}
+
+/* Returns the free block header at page PAGE_IDX in P. */
+static struct free_block *
+block_at(const struct pool *p, size_t page_idx)
+{
+    return (struct free_block *) (p->base + PGSIZE * page_idx);
+}
+
+/* Puts the free block of 2**ORDER pages at PAGE_IDX on P's
+ * free list for ORDER. */
+static void
+block_insert(struct pool *p, size_t page_idx, int order)
+{
+    p->free_order[page_idx] = order;
+    list_push_front(&p->free_lists[order], &block_at(p, page_idx)->elem);
+    p->block_cnt[order]++;
+}
+
+/* Takes the free block of 2**ORDER pages at PAGE_IDX off P's
+ * free list for ORDER. */
+static void
+block_remove(struct pool *p, size_t page_idx, int order)
+{
+    ASSERT(p->free_order[page_idx] == order);
+    p->free_order[page_idx] = NOT_FREE;
+    list_remove(&block_at(p, page_idx)->elem);
+    p->block_cnt[order]--;
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX in P, merging
+ * it with its buddy for as long as the buddy is free too. */
+static void
+block_free(struct pool *p, size_t page_idx, int order)
+{
+    while (order < PALLOC_MAX_ORDER) {
+        size_t buddy = page_idx ^ ((size_t) 1 << order);
+
+        if (buddy + ((size_t) 1 << order) > p->page_cnt
+            || p->free_order[buddy] != order) {
+            break;
+        }
+        block_remove(p, buddy, order);
+        if (buddy < page_idx) {
+            page_idx = buddy;
+        }
+        order++;
+    }
+    block_insert(p, page_idx, order);
+}
+
+/* Returns the largest order at most PALLOC_MAX_ORDER whose block
+ * both is aligned at PAGE_IDX and fits within PAGE_CNT pages. */
+static int
+largest_order(size_t page_idx, size_t page_cnt)
+{
+    int order = 0;
+
+    while (order < PALLOC_MAX_ORDER
+           && (page_idx & ((size_t) 1 << order)) == 0
+           && ((size_t) 2 << order) <= page_cnt) {
+        order++;
+    }
+    return order;
+}
+
+/* Frees the PAGE_CNT pages at PAGE_IDX in P, which need not form
+ * a single buddy block, by splitting them into the largest
+ * aligned blocks that they contain. */
+static void
+pool_free(struct pool *p, size_t page_idx, size_t page_cnt)
+{
+    bitmap_set_multiple(p->used_map, page_idx, page_cnt, false);
+    p->free_pages += page_cnt;
+    while (page_cnt > 0) {
+        int order = largest_order(page_idx, page_cnt);
+        size_t block_pages = (size_t) 1 << order;
+
+        block_free(p, page_idx, order);
+        page_idx += block_pages;
+        page_cnt -= block_pages;
+    }
+}
+
+/* Allocates PAGE_CNT contiguous pages from P and returns the
+ * index of the first, or BITMAP_ERROR if no free block is large
+ * enough. */
+static size_t
+pool_alloc(struct pool *p, size_t page_cnt)
+{
+    size_t page_idx;
+    int want = 0, order;
+
+    while (((size_t) 1 << want) < page_cnt) {
+        if (++want > PALLOC_MAX_ORDER) {
+            return BITMAP_ERROR;
+        }
+    }
+
+    for (order = want; order <= PALLOC_MAX_ORDER; order++) {
+        if (!list_empty(&p->free_lists[order])) {
+            break;
+        }
+    }
+    if (order > PALLOC_MAX_ORDER) {
+        return BITMAP_ERROR;
+    }
+
+    /* Take the block and split it down to the wanted order,
+     * returning the upper half each time. */
+    page_idx = pg_no(list_front(&p->free_lists[order])) - pg_no(p->base);
+    block_remove(p, page_idx, order);
+    while (order > want) {
+        order--;
+        block_insert(p, page_idx + ((size_t) 1 << order), order);
+    }
+
+    bitmap_set_multiple(p->used_map, page_idx, (size_t) 1 << want, true);
+    p->free_pages -= (size_t) 1 << want;
+
+    /* Give back the unused tail of a rounded-up block. */
+    if (page_cnt < ((size_t) 1 << want)) {
+        pool_free(p, page_idx + page_cnt, ((size_t) 1 << want) - page_cnt);
+    }
+    return page_idx;
+}
+
+/* Prints free space, fragmentation and allocation latency for
+ * pool P.  Fragmentation is the share of free pages that lie
+ * outside the largest free block, so 0% means all free memory
+ * is one contiguous block. */
+static void
+print_pool_stats(const struct pool *p)
+{
+    const struct pool_stats *s = &p->stats;
+    size_t largest = 0;
+    int order;
+
+    for (order = PALLOC_MAX_ORDER; order >= 0; order--) {
+        if (p->block_cnt[order] > 0) {
+            largest = (size_t) 1 << order;
+            break;
+        }
+    }
+
+    printf("Palloc: %s: %zu of %zu pages free, largest block %zu pages, "
+           "%zu%% fragmented\n", p->name, p->free_pages, p->page_cnt,
+           largest, p->free_pages > 0
+           ? (p->free_pages - largest) * 100 / p->free_pages : 0);
+    printf("Palloc: %s: free blocks by order:", p->name);
+    for (order = 0; order <= PALLOC_MAX_ORDER; order++) {
+        printf(" %zu", p->block_cnt[order]);
+    }
+    printf("\n");
+    printf("Palloc: %s: %lld allocs (%lld failed), %lld frees, "
+           "%"PRIu64" cycles avg, %"PRIu64" cycles max\n",
+           p->name, s->alloc_cnt, s->fail_cnt, s->free_cnt,
+           s->alloc_cnt > 0 ? s->alloc_cycles / s->alloc_cnt : 0,
+           s->max_cycles);
 }
 
 /* Returns true if PAGE was allocated from POOL,
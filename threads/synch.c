@@ -65,6 +65,7 @@ sema_down(struct semaphore *sema)
 
     ASSERT(sema != NULL);
     ASSERT(!intr_context());
+    ASSERT(!softirq_context());
 
     old_level = intr_disable();
     while (sema->value == 0) {
@@ -192,6 +193,7 @@ lock_acquire(struct lock *lock)
 {
     ASSERT(lock != NULL);
     ASSERT(!intr_context());
+    ASSERT(!softirq_context());
     ASSERT(!lock_held_by_current_thread(lock));
 
     sema_down(&lock->semaphore);
@@ -290,6 +292,7 @@ cond_wait(struct condition *cond, struct lock *lock)
     ASSERT(cond != NULL);
     ASSERT(lock != NULL);
     ASSERT(!intr_context());
+    ASSERT(!softirq_context());
     ASSERT(lock_held_by_current_thread(lock));
 
     sema_init(&waiter.semaphore, 0);
@@ -4,9 +4,11 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "devices/timer.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
@@ -37,6 +39,9 @@ static struct thread *idle_thread;
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
+/* Cache of struct child, one per thread created. */
+static struct kmem_cache *child_cache;
+
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
@@ -120,6 +125,11 @@ void
 thread_start(void)
 {
     log(L_TRACE, "thread_start");
+    child_cache = kmem_cache_create("child", sizeof(struct child), NULL);
+    if (child_cache == NULL) {
+        PANIC("thread_start: out of memory");
+    }
+
     /* Create the idle thread. */
     struct semaphore idle_started;
     sema_init(&idle_started, 0);
@@ -204,7 +214,7 @@ thread_create(const char *name, int priority,
     tid = t->tid = allocate_tid();
     //printf("DEBUG created thread (%s) with tid: %d\n", name, tid);
     /* PROJECT2: USERPROG */
-    struct child* c = palloc_get_page(0);
+    struct child* c = kmem_cache_alloc(child_cache);
     c->tid = tid;
     c->waiting = false;
     sema_init(&c->wait_sema, 0);
@@ -362,6 +372,13 @@ thread_foreach(thread_action_func *func, void *aux)
     }
 }
 
+/* Frees C, a child record made by thread_create(). */
+void
+thread_free_child(struct child *c)
+{
+    kmem_cache_free(child_cache, c);
+}
+
 /* Sets the current thread's priority to NEW_PRIORITY. */
 void
 thread_set_priority(int new_priority)
@@ -429,6 +446,10 @@ idle(void *idle_started_ UNUSED)
         intr_disable();
         thread_block();
 
+        /* Nothing else is runnable.  Maybe stop the periodic
+         * timer tick until the next deadline. */
+        timer_idle_enter();
+
         /* Re-enable interrupts and wait for the next one.
          *
          * The `sti' instruction disables interrupts until the
@@ -502,6 +523,7 @@ init_thread(struct thread *t, const char *name, int priority)
     t->waiting_for = NULL;
     list_init (&t->files);
     t->self_file = NULL;
+    t->exec_image = NULL;
     t->fd_count = 2;
     t->page_table = NULL;
 
@@ -595,11 +617,20 @@ static void
 schedule(void)
 {
     struct thread *cur = running_thread();
-    struct thread *next = next_thread_to_run();
+    struct thread *next;
     struct thread *prev = NULL;
 
     ASSERT(intr_get_level() == INTR_OFF);
     ASSERT(cur->status != THREAD_RUNNING);
+
+    /* If the idle thread stopped the periodic tick, restart it
+     * before anything else runs.  Catching up may wake sleepers,
+     * so do it before choosing the next thread. */
+    if (cur == idle_thread) {
+        idle_ticks += timer_idle_exit();
+    }
+
+    next = next_thread_to_run();
     ASSERT(is_thread(next));
 
     if (cur != next) {
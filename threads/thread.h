@@ -2,6 +2,7 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <heap.h>
 #include <list.h>
 #include <stdint.h>
 #include "threads/synch.h"
@@ -19,6 +20,10 @@ enum thread_status {
 typedef int tid_t;
 #define TID_ERROR ((tid_t)-1) /* Error value for tid_t. */
 
+/* Number of entries in a thread's page_get() cache, see vm/page.c.
+ * Must be a power of 2. */
+#define PAGE_TLB_SIZE 16
+
 /* Thread priorities. */
 #define PRI_MIN     0  /* Lowest priority. */
 #define PRI_DEFAULT 31 /* Default priority. */
@@ -92,6 +97,10 @@ struct thread {
     /* Shared between thread.c and synch.c. */
     struct list_elem elem; /* List element. */
 
+    /* Owned by devices/timer.c. */
+    int64_t          wake_tick;  /* Tick to wake up at, if sleeping. */
+    struct heap_elem sleep_elem; /* Element in the sleeping threads heap. */
+
 // TODO: Remove comments on release. VSCode compaints without these comments
 //#ifdef USERPROG
     /* Owned by userprog/process.c. */
@@ -109,11 +118,15 @@ struct thread {
     bool load_success; /* was load successfull see process.c:start_process */
     int exit_code; /* exit code/status of the thread */
     struct file *self_file;  /* file that the thread executes */  
+    struct exec_image *exec_image; /* parsed headers of self_file, see process.c */
     struct list files; /* list of files */
     int fd_count; /* count of file descriptors */
 
     /* PROJECT3: VM */
-    struct hash *page_table; /* page table*/
+    struct rhash *page_table; /* page table*/
+    struct page *page_tlb[PAGE_TLB_SIZE]; /* recent page_get() results */
+    size_t page_meta_bytes; /* bytes of struct page, see page.c */
+    size_t frame_meta_bytes; /* bytes of struct frame owned, under frame_lock */
     uint8_t *latest_esp;
 };
 
@@ -151,6 +164,8 @@ void thread_yield(void);
 typedef void thread_action_func (struct thread *t, void *aux);
 void thread_foreach(thread_action_func *, void *);
 
+void thread_free_child(struct child *);
+
 int thread_get_priority(void);
 void thread_set_priority(int);
 int thread_get_nice(void);
@@ -0,0 +1,19 @@
+#ifndef THREADS_TSC_H
+#define THREADS_TSC_H
+
+#include <stdint.h>
+
+/* Returns the processor's time stamp counter, which counts CPU
+ * cycles since reset.  Cheap enough to bracket short critical
+ * paths for latency statistics. */
+static inline uint64_t
+rdtsc(void)
+{
+    /* See [IA32-v2b] "RDTSC". */
+    uint64_t tsc;
+
+    asm volatile ("rdtsc" : "=A" (tsc));
+    return tsc;
+}
+
+#endif /* threads/tsc.h */
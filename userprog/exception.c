@@ -162,7 +162,13 @@ page_fault(struct intr_frame *f)
         if (page_get(pg_round_down(fault_addr)) == NULL && valid_stack_addr){
             page_create(pg_round_down(fault_addr), ZERO_PAGE, NULL);
         }
-        load_page_success = handle_page_fault(fault_addr);
+        load_page_success = handle_page_fault(fault_addr, write);
+    }
+    else if (write){
+        /* first store to a page still mapped to the shared zero frame */
+        if (handle_page_write_fault(fault_addr)){
+            return;
+        }
     }
 
     /* kernel trying to write into page present in page table*/
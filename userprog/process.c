@@ -11,7 +11,9 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/gdt.h"
@@ -26,19 +28,44 @@
 #include <log.h>
 
 
+/* Maximum number of command-line arguments, including the
+ * program name. */
+#define EXEC_ARGS_MAX 128
+
+/* Maximum length of a command line, counting its null terminator.
+ * Longer command lines are truncated.  setup_stack() pushes the
+ * argument strings, which take at most this many bytes, up to 3
+ * bytes of padding, the argv[] array with its null sentinel, and
+ * argv, argc, and a return address, all in the initial stack
+ * page. */
+#define EXEC_CMD_LINE_MAX (PGSIZE                                      \
+                           - (EXEC_ARGS_MAX + 1) * sizeof(char *)      \
+                           - 3 * sizeof(void *) - 3)
+
+/* Command line of a new process, split into arguments once by
+ * process_execute() and handed to the child.  The whole structure
+ * lives in a single page: the argument vector followed by the
+ * tokenized copy of the command line that it points into. */
+struct exec_args {
+    int   argc;                     /* Number of arguments. */
+    char *argv[EXEC_ARGS_MAX + 1];  /* Arguments, null-terminated. */
+    char  cmd_line[];               /* Tokenized command line. */
+};
+
 static thread_func start_process NO_RETURN;
-static bool load(void(**eip) (void), void **esp, const char* fn_copy);
+static struct exec_args *exec_args_create(const char *cmd_line);
+static bool load(void(**eip) (void), void **esp, const struct exec_args *);
+static void exec_image_release(struct exec_image *);
 
 /* Starts a new thread running a user program loaded from
- * FILENAME.  The new thread may be scheduled (and may even exit)
+ * FILE_NAME.  The new thread may be scheduled (and may even exit)
  * before process_execute() returns.  Returns the new process's
  * thread id, or TID_ERROR if the thread cannot be created. */
 tid_t
 process_execute(const char *file_name)
 {
-    char *fn_copy;
+    struct exec_args *args;
     tid_t tid;
-    struct thread *parent_thread = thread_current();
 
     // NOTE:
     // To see this print, make sure LOGGING_LEVEL in this file is <= L_TRACE (6)
@@ -46,27 +73,18 @@ process_execute(const char *file_name)
     // Also, probably won't pass with logging enabled.
     log(L_TRACE, "Started process execute: %s", file_name);
 
-    /* Make a copy of FILE_NAME.
+    /* Make a parsed copy of FILE_NAME.
      * Otherwise there's a race between the caller and load(). */
-    fn_copy = palloc_get_page(0);
-    if (fn_copy == NULL) {
+    args = exec_args_create(file_name);
+    if (args == NULL) {
         return TID_ERROR;
     }
-    strlcpy(fn_copy, file_name, PGSIZE);
-    
-    /* copy temp program name to pass into thread_create */
-    char *save_ptr;
-    char *program_name = palloc_get_page(0);
-    strlcpy(program_name, file_name, PGSIZE);
-    program_name = strtok_r(program_name, " ", &save_ptr);
 
     /* Create a new thread to execute FILE_NAME. */
-    tid = thread_create(program_name, PRI_DEFAULT, start_process, fn_copy);
-
-    palloc_free_page(program_name);
-
+    tid = thread_create(args->argv[0], PRI_DEFAULT, start_process, args);
     if (tid == TID_ERROR) {
-        palloc_free_page(fn_copy);
+        palloc_free_page(args);
+        return TID_ERROR;
     }
 
     sema_down(&thread_current()->exec_sema);
@@ -77,15 +95,48 @@ process_execute(const char *file_name)
     return tid;
 }
 
+/* Copies CMD_LINE, truncated to EXEC_CMD_LINE_MAX bytes, into a
+ * newly allocated page and splits it into arguments at spaces.  Returns the arguments, or a null pointer
+ * if memory is exhausted or CMD_LINE has no words or too many
+ * of them. */
+static struct exec_args *
+exec_args_create(const char *cmd_line)
+{
+    struct exec_args *args = palloc_get_page(0);
+    char *token, *save_ptr;
+
+    if (args == NULL) {
+        return NULL;
+    }
+    ASSERT(sizeof *args + EXEC_CMD_LINE_MAX <= PGSIZE);
+    strlcpy(args->cmd_line, cmd_line, EXEC_CMD_LINE_MAX);
+
+    args->argc = 0;
+    for (token = strtok_r(args->cmd_line, " ", &save_ptr); token != NULL;
+         token = strtok_r(NULL, " ", &save_ptr)) {
+        if (args->argc == EXEC_ARGS_MAX) {
+            palloc_free_page(args);
+            return NULL;
+        }
+        args->argv[args->argc++] = token;
+    }
+    args->argv[args->argc] = NULL;
+
+    if (args->argc == 0) {
+        palloc_free_page(args);
+        return NULL;
+    }
+    return args;
+}
+
 /* A thread function that loads a user process and starts it
  * running. */
 static void
-start_process(void *fn_copy_)
+start_process(void *args_)
 {
     struct intr_frame if_;
-    struct thread *t = thread_current();
     bool success;
-    char *file_name = fn_copy_;
+    struct exec_args *args = args_;
 
     log(L_TRACE, "start_process()");
 
@@ -94,12 +145,12 @@ start_process(void *fn_copy_)
     if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
     if_.cs = SEL_UCSEG;
     if_.eflags = FLAG_IF | FLAG_MBS;
-    success = load(&if_.eip, &if_.esp, file_name);
+    success = load(&if_.eip, &if_.esp, args);
 
     thread_current()->parent->load_success = success;
 
-    /* free the first copy of the file_name */
-    palloc_free_page (file_name); 
+    /* arguments are on the user stack now */
+    palloc_free_page (args);
 
     //printf("DEBUG exec sema up for parent: %d\n", thread_current()->parent->tid);
     sema_up(&thread_current()->parent->exec_sema);
@@ -170,7 +221,6 @@ process_exit(void)
 
     /* close files */
     acquire_filesys_lock();
-    file_close(thread_current()->self_file);
     clean_all_files(&thread_current()->files);
     release_filesys_lock();
 
@@ -180,12 +230,22 @@ process_exit(void)
 	{
 		struct child *ch = list_entry (list_pop_front(&cur->children), struct child, elem);
 		list_remove(&ch->elem);
-		palloc_free_page(ch);
+		thread_free_child(ch);
 	}
 
     /* destroy thread's hash-table */
     clear_page_table();
 
+    /* The image cache and the shared frame table are keyed by the
+     * executable's inode, so drop our references to both before
+     * closing the file that keeps the inode alive. */
+    exec_image_release(cur->exec_image);
+    cur->exec_image = NULL;
+    acquire_filesys_lock();
+    file_close(cur->self_file);
+    release_filesys_lock();
+    cur->self_file = NULL;
+
     /* Destroy the current process's page directory and switch back
      * to the kernel-only page directory. */
     pd = cur->pagedir;
@@ -281,65 +341,69 @@ struct Elf32_Phdr {
 #define PF_W 2 /* Writable. */
 #define PF_R 4 /* Readable. */
 
-static bool setup_stack(void **esp, char* fn_copy);
+/* Parsed headers of an executable.  Every process running the
+ * same executable shares one image, so only the first exec of
+ * a binary reads and validates its ELF and program headers;
+ * later ones just walk the cached PT_LOAD segments.  An image
+ * lives as long as some process holds it, and since each holder
+ * keeps its executable open with writes denied, the cached
+ * headers cannot go stale. */
+struct exec_image {
+    struct list_elem   elem;     /* Element in exec_images. */
+    struct inode      *inode;    /* Executable's inode. */
+    int                ref_cnt;  /* Processes using this image. */
+    struct lock        lock;     /* Serializes parsing. */
+    bool               parsed;   /* Have the headers been read? */
+    bool               valid;    /* Is this a loadable executable? */
+    Elf32_Addr         entry;    /* Entry point. */
+    int                load_cnt; /* Number of PT_LOAD segments. */
+    struct Elf32_Phdr *loads;    /* Validated PT_LOAD program headers. */
+};
+
+/* All images in use, protected by exec_images_lock. */
+static struct list exec_images;
+static struct lock exec_images_lock;
+
+/* Initializes the executable image cache. */
+void
+process_init(void)
+{
+    list_init(&exec_images);
+    lock_init(&exec_images_lock);
+}
+
+static bool setup_stack(void **esp, const struct exec_args *args);
 
 static bool validate_segment(const struct Elf32_Phdr *, struct file *);
 static bool load_segment(struct file *file, off_t ofs, uint8_t *upage, uint32_t read_bytes, uint32_t zero_bytes, bool writable);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
- * Stores the executable's entry point into *EIP
- * and its initial stack pointer into *ESP.
- * Returns true if successful, false otherwise. */
-bool
-load(void(**eip) (void), void **esp, const char* fn_copy)
+/* Reads and validates the headers of executable FILE into IMAGE.
+ * Returns true if FILE is a loadable executable. */
+static bool
+exec_image_parse(struct exec_image *image, struct file *file)
 {
-    log(L_TRACE, "load()");
-    struct thread *t = thread_current();
     struct Elf32_Ehdr ehdr;
-    struct file *file = NULL;
     off_t file_ofs;
-    bool success = false;
     int i;
 
-    acquire_filesys_lock();
-
-    /* Allocate and activate page directory. */
-    t->pagedir = pagedir_create();
-    if (t->pagedir == NULL) {
-        goto done;
-    }
-    process_activate();
-
-    /* Create page hash-table. */
-    t->page_table = malloc (sizeof *t->page_table);
-    if (t->page_table == NULL)
-        goto done;
-    hash_init (t->page_table, page_hash_func, page_less_func, NULL);
-
-    /* create temp program name copy for loading new process */
-    char* program_name = palloc_get_page(0);
-    strlcpy(program_name, fn_copy, PGSIZE);
-    char *save_ptr;
-    program_name = strtok_r(program_name," ",&save_ptr);
-
-    /* Open executable file. */
-    file = filesys_open(program_name);
-    
-    if (file == NULL) {
-        printf("load: %s: open failed\n", program_name);
-        goto done;
-    }
-
     /* Read and verify executable header. */
-    if (file_read(file, &ehdr, sizeof ehdr) != sizeof ehdr
+    if (file_read_at(file, &ehdr, sizeof ehdr, 0) != sizeof ehdr
         || memcmp(ehdr.e_ident, "\177ELF\1\1\1", 7)
         || ehdr.e_type != 2
         || ehdr.e_machine != 3
         || ehdr.e_version != 1
         || ehdr.e_phentsize != sizeof(struct Elf32_Phdr)
         || ehdr.e_phnum > 1024) {
-        printf("load: %s: error loading executable\n", program_name);
-        goto done;
+        return false;
+    }
+    image->entry = ehdr.e_entry;
+    if (ehdr.e_phnum == 0) {
+        return true;
+    }
+
+    image->loads = malloc(ehdr.e_phnum * sizeof *image->loads);
+    if (image->loads == NULL) {
+        return false;
     }
 
     /* Read program headers. */
@@ -348,12 +412,10 @@ load(void(**eip) (void), void **esp, const char* fn_copy)
         struct Elf32_Phdr phdr;
 
         if (file_ofs < 0 || file_ofs > file_length(file)) {
-            goto done;
+            return false;
         }
-        file_seek(file, file_ofs);
-
-        if (file_read(file, &phdr, sizeof phdr) != sizeof phdr) {
-            goto done;
+        if (file_read_at(file, &phdr, sizeof phdr, file_ofs) != sizeof phdr) {
+            return false;
         }
         file_ofs += sizeof phdr;
         switch (phdr.p_type) {
@@ -367,55 +429,188 @@ load(void(**eip) (void), void **esp, const char* fn_copy)
         case PT_DYNAMIC:
         case PT_INTERP:
         case PT_SHLIB:
-            goto done;
+            return false;
         case PT_LOAD:
-            if (validate_segment(&phdr, file)) {
-                bool writable = (phdr.p_flags & PF_W) != 0;
-                uint32_t file_page = phdr.p_offset & ~PGMASK;
-                uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
-                uint32_t page_offset = phdr.p_vaddr & PGMASK;
-                uint32_t read_bytes, zero_bytes;
-                if (phdr.p_filesz > 0) {
-                    /* Normal segment.
-                     * Read initial part from disk and zero the rest. */
-                    read_bytes = page_offset + phdr.p_filesz;
-                    zero_bytes = (ROUND_UP(page_offset + phdr.p_memsz, PGSIZE)
-                                  - read_bytes);
-                } else {
-                    /* Entirely zero.
-                     * Don't read anything from disk. */
-                    read_bytes = 0;
-                    zero_bytes = ROUND_UP(page_offset + phdr.p_memsz, PGSIZE);
-                }
-                if (!load_segment(file, file_page, (void *)mem_page,
-                                  read_bytes, zero_bytes, writable)) {
-                    goto done;
-                }
-            } else {
-                goto done;
+            if (!validate_segment(&phdr, file)) {
+                return false;
             }
+            image->loads[image->load_cnt++] = phdr;
+            break;
+        }
+    }
+    return true;
+}
+
+/* Returns the image of executable FILE, parsing its headers if
+ * no other process is running it, or a null pointer if memory is
+ * exhausted.  Only the image's own lock is held while parsing, so
+ * execs of different programs proceed in parallel.  The caller
+ * must release the image with exec_image_release(). */
+static struct exec_image *
+exec_image_get(struct file *file)
+{
+    struct inode *inode = file_get_inode(file);
+    struct exec_image *image = NULL;
+    struct list_elem *e;
+
+    lock_acquire(&exec_images_lock);
+    for (e = list_begin(&exec_images); e != list_end(&exec_images);
+         e = list_next(e)) {
+        struct exec_image *cur = list_entry(e, struct exec_image, elem);
+        if (cur->inode == inode) {
+            image = cur;
             break;
         }
     }
+    if (image == NULL) {
+        image = malloc(sizeof *image);
+        if (image == NULL) {
+            lock_release(&exec_images_lock);
+            return NULL;
+        }
+        image->inode = inode;
+        image->ref_cnt = 0;
+        lock_init(&image->lock);
+        image->parsed = false;
+        image->valid = false;
+        image->entry = 0;
+        image->load_cnt = 0;
+        image->loads = NULL;
+        list_push_back(&exec_images, &image->elem);
+    }
+    image->ref_cnt++;
+    lock_release(&exec_images_lock);
+
+    lock_acquire(&image->lock);
+    if (!image->parsed) {
+        image->valid = exec_image_parse(image, file);
+        image->parsed = true;
+    }
+    lock_release(&image->lock);
+
+    return image;
+}
+
+/* Drops a reference to IMAGE, freeing it when the last process
+ * running the executable is done with it.  IMAGE may be null. */
+static void
+exec_image_release(struct exec_image *image)
+{
+    if (image == NULL) {
+        return;
+    }
+
+    lock_acquire(&exec_images_lock);
+    if (--image->ref_cnt == 0) {
+        list_remove(&image->elem);
+        free(image->loads);
+        free(image);
+    }
+    lock_release(&exec_images_lock);
+}
+
+/* Loads an ELF executable named by ARGS->argv[0] into the current
+ * thread and pushes ARGS onto its stack.
+ * Stores the executable's entry point into *EIP
+ * and its initial stack pointer into *ESP.
+ * Returns true if successful, false otherwise. */
+bool
+load(void(**eip) (void), void **esp, const struct exec_args *args)
+{
+    log(L_TRACE, "load()");
+    struct thread *t = thread_current();
+    const char *program_name = args->argv[0];
+    struct exec_image *image;
+    struct file *file = NULL;
+    bool success = false;
+    int i;
+
+    /* Allocate and activate page directory. */
+    t->pagedir = pagedir_create();
+    if (t->pagedir == NULL) {
+        goto done;
+    }
+    process_activate();
+
+    /* Create page hash-table. */
+    t->page_table = malloc (sizeof *t->page_table);
+    if (t->page_table == NULL)
+        goto done;
+    if (!rhash_init (t->page_table, page_hash_func, page_less_func, NULL))
+        goto done;
+
+    /* Open executable file.  Only the directory lookup needs the
+     * global file system lock: once writes are denied, the file's
+     * contents are stable and can be read without it. */
+    acquire_filesys_lock();
+    file = filesys_open(program_name);
+    if (file != NULL) {
+        file_deny_write(file);
+    }
+    release_filesys_lock();
+
+    if (file == NULL) {
+        printf("load: %s: open failed\n", program_name);
+        goto done;
+    }
+
+    /* Read and verify the headers, or reuse them if another
+     * process is already running this executable. */
+    image = exec_image_get(file);
+    t->exec_image = image;
+    if (image == NULL || !image->valid) {
+        printf("load: %s: error loading executable\n", program_name);
+        goto done;
+    }
+
+    for (i = 0; i < image->load_cnt; i++) {
+        const struct Elf32_Phdr *phdr = &image->loads[i];
+        bool writable = (phdr->p_flags & PF_W) != 0;
+        uint32_t file_page = phdr->p_offset & ~PGMASK;
+        uint32_t mem_page = phdr->p_vaddr & ~PGMASK;
+        uint32_t page_offset = phdr->p_vaddr & PGMASK;
+        uint32_t read_bytes, zero_bytes;
+        if (phdr->p_filesz > 0) {
+            /* Normal segment.
+             * Read initial part from disk and zero the rest. */
+            read_bytes = page_offset + phdr->p_filesz;
+            zero_bytes = (ROUND_UP(page_offset + phdr->p_memsz, PGSIZE)
+                          - read_bytes);
+        } else {
+            /* Entirely zero.
+             * Don't read anything from disk. */
+            read_bytes = 0;
+            zero_bytes = ROUND_UP(page_offset + phdr->p_memsz, PGSIZE);
+        }
+        if (!load_segment(file, file_page, (void *)mem_page,
+                          read_bytes, zero_bytes, writable)) {
+            goto done;
+        }
+    }
 
     /* Set up stack. */
-    if (!setup_stack(esp, fn_copy)) {
+    if (!setup_stack(esp, args)) {
         goto done;
     }
 
     /* Start address. */
-    *eip = (void (*)(void))ehdr.e_entry;
+    *eip = (void (*)(void))image->entry;
 
     success = true;
 
-    /* deny writing to file that's being executed */
-    file_deny_write(file);
-    //printf("DEBUG denying write to file: %d\n", &file);
-    thread_current()->self_file = file;
 done:
     /* We arrive here whether the load is successful or not. */
-    release_filesys_lock();
-    palloc_free_page(program_name);
+    if (success) {
+        /* keep writes to the executable denied while it runs */
+        t->self_file = file;
+    } else if (file != NULL) {
+        /* the image is keyed by the file's inode: let go of it first */
+        exec_image_release(t->exec_image);
+        t->exec_image = NULL;
+        acquire_filesys_lock();
+        file_close(file);
+        release_filesys_lock();
+    }
     return success;
 }
 
@@ -566,7 +761,7 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
             0xbfffffcc	    return address	0	        void (*) ()
              */
 static bool
-setup_stack(void **esp, char *fn_copy)
+setup_stack(void **esp, const struct exec_args *args)
 {
 
     uint8_t *kpage;
@@ -574,29 +769,24 @@ setup_stack(void **esp, char *fn_copy)
 
     log(L_TRACE, "setup_stack()");
 
+    /* exec_args_create() bounds the length of the command line
+     * and the number of arguments so that everything pushed below
+     * fits in this page; see EXEC_CMD_LINE_MAX. */
     kpage = frame_allocate(PAL_USER | PAL_ZERO, PHYS_BASE - PGSIZE);
     if (kpage != NULL) {
         success = install_page(((uint8_t *)PHYS_BASE) - PGSIZE, kpage, true);
         if (success) {
             *esp = PHYS_BASE;
-            char** tokens = palloc_get_page(0);
-            int argc = 0;
-            char *save_ptr;
-            char *token;
-            for (token = strtok_r(fn_copy, " ", &save_ptr);
-            token != NULL;
-            token = strtok_r(NULL, " ", &save_ptr)){
-                tokens[argc++] = token;
-            }
+            int argc = args->argc;
             int arg_len;
             void *argv_pointers[argc];
 
             //push argvs in reverse order
             for(int i = argc - 1; i >= 0; i--){
-                arg_len = strlen(tokens[i]) + 1;
+                arg_len = strlen(args->argv[i]) + 1;
                 *esp -= arg_len;
                 argv_pointers[i] = *esp;
-                memcpy(*esp, tokens[i], arg_len);
+                memcpy(*esp, args->argv[i], arg_len);
             }
 
             //push word allign padding
@@ -626,8 +816,6 @@ setup_stack(void **esp, char *fn_copy)
             *esp -= 4;
             *((uint32_t*) *esp) = 0x0;
 
-             palloc_free_page(tokens);
-
         } else {
             frame_free(kpage, true, true);
         }
@@ -657,7 +845,14 @@ install_page(void *upage, void *kpage, bool writable)
 
     /* Verify that there's not already a page at that virtual
      * address, then map our page there. */
-    return pagedir_get_page(t->pagedir, upage) == NULL
-           && pagedir_set_page(t->pagedir, upage, kpage, writable)
-           && page_create(upage, FROM_FRAME, &aux);
+    if (pagedir_get_page(t->pagedir, upage) != NULL
+        || !pagedir_set_page(t->pagedir, upage, kpage, writable)) {
+        return false;
+    }
+    if (!page_create(upage, FROM_FRAME, &aux)) {
+        /* the caller frees KPAGE, so don't leave it mapped */
+        pagedir_clear_page(t->pagedir, upage);
+        return false;
+    }
+    return true;
 }
\ No newline at end of file
@@ -12,6 +12,7 @@
 //     char *save_ptr; /* save_ptr for strtok_r parsing */
 // };
 
+void process_init(void);
 tid_t process_execute(const char *file_name);
 int process_wait(tid_t);
 void process_exit(void);
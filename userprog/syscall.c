@@ -8,10 +8,12 @@
 #include <syscall-nr.h>
 #include "userprog/process.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "filesys/off_t.h"
 #include "kernel/list.h"
+#include "devices/input.h"
 #include "devices/shutdown.h"
 #include "vm/page.h"
 
@@ -20,6 +22,8 @@ int exec_process(char *file_name);
 void exit_process(int status);
 void * is_valid_addr(const void *vaddr);
 struct process_file* search_fd(struct list* files, int fd);
+static bool copy_to_user(void *udst, const void *src, size_t size);
+static bool copy_from_user(void *dst, const void *usrc, size_t size);
 void clean_single_file(struct list* files, int fd);
 
 
@@ -35,6 +39,8 @@ int syscall_write(struct intr_frame *f);
 void syscall_seek(struct intr_frame *f);
 int syscall_tell(struct intr_frame *f);
 void syscall_close(struct intr_frame *f);
+int syscall_intr_stats(struct intr_frame *f);
+int syscall_vm_stats(void);
 void syscall_halt(void);
 
 
@@ -82,6 +88,8 @@ syscall_handler (struct intr_frame *f UNUSED)
 		case SYS_SEEK: syscall_seek(f); break;
 		case SYS_TELL: f->eax = syscall_tell(f); break;
 		case SYS_CLOSE: syscall_close(f); break;
+		case SYS_INTR_STATS: f->eax = syscall_intr_stats(f); break;
+		case SYS_VM_STATS: f->eax = syscall_vm_stats(); break;
 
 		default:
 		printf("Default %d\n",*p);
@@ -216,6 +224,50 @@ syscall_wait(struct intr_frame *f)
 	return process_wait(child_tid);
 }
 
+/*most bytes a single read() from the console returns*/
+#define STDIN_CHUNK 128
+
+/*write() to the console is passed to putbuf() this many bytes at a time*/
+#define STDOUT_CHUNK 256
+
+/*copies SIZE bytes from kernel SRC to user UDST, faulting in and
+  pinning the destination first. Returns false if UDST is not a valid
+  user buffer.*/
+static bool
+copy_to_user(void *udst, const void *src, size_t size){
+	if (size == 0){
+		return true;
+	}
+	acquire_filesys_lock();
+	if (!preload_multiple_pages_and_pin(udst, size)){
+		release_filesys_lock();
+		return false;
+	}
+	memcpy(udst, src, size);
+	unpin_multiple_pages(udst, size);
+	release_filesys_lock();
+	return true;
+}
+
+/*copies SIZE bytes from user USRC to kernel DST, faulting in and
+  pinning the source first. Returns false if USRC is not a valid user
+  buffer.*/
+static bool
+copy_from_user(void *dst, const void *usrc, size_t size){
+	if (size == 0){
+		return true;
+	}
+	acquire_filesys_lock();
+	if (!preload_multiple_pages_and_pin(usrc, size)){
+		release_filesys_lock();
+		return false;
+	}
+	memcpy(dst, usrc, size);
+	unpin_multiple_pages(usrc, size);
+	release_filesys_lock();
+	return true;
+}
+
 int
 syscall_read(struct intr_frame *f)
 {
@@ -229,11 +281,19 @@ syscall_read(struct intr_frame *f)
 		exit_process(-1);
 	}
 	if (fd == 0){
-		int i;
-		uint8_t *buffer = buffer;
-		for (i = 0; i < size; i++)
-			buffer[i] = input_getc();
-		ret = size;
+		/* Returns at the end of a line rather than waiting
+		   for all SIZE bytes. input_read() holds the console's
+		   read lock, so it fills a kernel buffer that cannot fault
+		   and the user copy happens after the lock is dropped. */
+		uint8_t kbuf[STDIN_CHUNK];
+		ret = 0;
+		if (size > 0){
+			ret = input_read(kbuf, size < STDIN_CHUNK ? size : STDIN_CHUNK, true);
+			if (!copy_to_user(buffer, kbuf, ret)){
+				exit_process(-1);
+				return 0;
+			}
+		}
 	}
 	else{ // fd != 0
 		struct process_file* fptr = search_fd(&thread_current()->files, fd);
@@ -243,7 +303,6 @@ syscall_read(struct intr_frame *f)
 			{
 				acquire_filesys_lock();
 				if (!preload_multiple_pages_and_pin(buffer, size)){
-					unpin_multiple_pages(buffer, size);
 					release_filesys_lock();
 					exit_process(-1);
 					return 0;
@@ -269,7 +328,18 @@ syscall_write(struct intr_frame *f)
 	is_valid_addr(buffer+size-1);
 
 	if (fd == 1){
-		putbuf(buffer, size);
+		/* putbuf() reads its buffer with interrupts off, where a
+		   page fault is not allowed, so hand it kernel copies. */
+		char kbuf[STDOUT_CHUNK];
+		int done;
+		for (done = 0; done < size; done += STDOUT_CHUNK){
+			int n = size - done < STDOUT_CHUNK ? size - done : STDOUT_CHUNK;
+			if (!copy_from_user(kbuf, (char *) buffer + done, n)){
+				exit_process(-1);
+				return 0;
+			}
+			putbuf(kbuf, n);
+		}
 		ret = size;
 	}
 	else {
@@ -279,7 +349,6 @@ syscall_write(struct intr_frame *f)
 			else{
 				acquire_filesys_lock();
 				if (!preload_multiple_pages_and_pin(buffer, size)){
-					unpin_multiple_pages(buffer, size);
 					release_filesys_lock();
 					exit_process(-1);
 					return 0;
@@ -379,4 +448,40 @@ void syscall_close(struct intr_frame *f){
 	acquire_filesys_lock();
 	clean_single_file(&thread_current()->files, fd);
 	release_filesys_lock();
-}
\ No newline at end of file
+}
+
+/*copy interrupt statistics into user buffer, like snprintf*/
+int syscall_intr_stats(struct intr_frame *f){
+	int **call_args = f->esp;
+	char *buffer;
+	unsigned size;
+	char *report;
+	size_t len, n;
+
+	is_valid_addr(call_args + 2);
+	buffer = (char *) call_args[1];
+	size = (unsigned) call_args[2];
+	if (size == 0)
+		return 0;
+
+	/* Format into a kernel page first, then copy out the part that
+	   fits through a pinned range, as strlcpy() would. */
+	report = palloc_get_page(0);
+	if (report == NULL)
+		return -1;
+	len = intr_format_stats(report, PGSIZE);
+	n = len < size ? len : size - 1;
+	report[n] = '\0';
+	if (!copy_to_user(buffer, report, n + 1)){
+		palloc_free_page(report);
+		exit_process(-1);
+		return 0;
+	}
+	palloc_free_page(report);
+	return len;
+}
+
+/*bytes of VM metadata held by the calling process, see page_meta_bytes()*/
+int syscall_vm_stats(void){
+	return page_meta_bytes(thread_current());
+}
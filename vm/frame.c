@@ -6,16 +6,28 @@
 #include "threads/malloc.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
+#include "filesys/file.h"
+#include <hash.h>
 #include <stdio.h>
 #include <string.h>
 
 static struct lock frame_lock;
 static struct list frame_clock_list; 
-static struct hash frame_table;
+static struct rhash frame_table;
+static struct rhash share_table; /* shared read-only frames by (inode, offset, length) */
 static struct list_elem *clock_ptr; /* clock algorithm pointer */
-
-static unsigned frame_hash_func(const struct hash_elem *elem, void *aux);
-static bool  frame_less_func(const struct hash_elem *, const struct hash_elem *, void *aux);
+static void *zero_kpage; /* all-zero frame mapped by untouched ZERO_PAGEs */
+static struct kmem_cache *frame_cache; /* struct frame objects */
+
+static unsigned frame_hash_func(const struct rhash_elem *elem, void *aux);
+static bool  frame_less_func(const struct rhash_elem *, const struct rhash_elem *, void *aux);
+static unsigned share_hash_func(const struct rhash_elem *elem, void *aux);
+static bool share_less_func(const struct rhash_elem *, const struct rhash_elem *, void *aux);
+static void frame_share_unmap_all(struct frame *f);
+static void frame_detach(struct frame *f);
+static void frame_ctor(void *f_);
+static void frame_destroy(struct frame *f);
+static void frame_set_owner(struct frame *f, struct page *p);
 struct frame * find_frame_to_evict(struct thread*);
 
 void
@@ -24,7 +36,25 @@ frame_table_init ()
     clock_ptr = NULL;
     lock_init (&frame_lock);
     list_init (&frame_clock_list);
-    hash_init (&frame_table, frame_hash_func, frame_less_func, NULL);
+    if (!rhash_init (&frame_table, frame_hash_func, frame_less_func, NULL)
+        || !rhash_init (&share_table, share_hash_func, share_less_func, NULL)){
+        PANIC("Could not create frame tables");
+    }
+    frame_cache = kmem_cache_create ("frame", sizeof (struct frame), frame_ctor);
+    if (frame_cache == NULL){
+        PANIC("Could not create frame cache");
+    }
+
+    /* never on the clock list, so never evicted or freed */
+    zero_kpage = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+}
+
+/* Returns the global all-zero frame. ZERO_PAGEs that are only read map
+   it read-only instead of getting a frame of their own; the first store
+   gives them a private copy (see handle_page_write_fault). */
+void *
+frame_zero_page(void){
+    return zero_kpage;
 }
 
 /* Get frame from the frame table by it's kernel page */
@@ -32,17 +62,21 @@ struct frame*
 frame_get (const void* kpage){
     struct frame temp_frame;
     temp_frame.kpage = kpage;
-    struct hash_elem *h = hash_find (&frame_table, &(temp_frame.hash_elem));
+    struct rhash_elem *h = rhash_find (&frame_table, &(temp_frame.hash_elem));
     if (h == NULL) {
         return NULL;
     }
     else {
-        return hash_entry(h, struct frame, hash_elem);
+        return rhash_entry(h, struct frame, hash_elem);
     }
 }
 
 void * frame_allocate (enum palloc_flags flags, void *upage){
 
+    /* comes with an empty `sharers' list, see frame_ctor() */
+    struct frame *frame = kmem_cache_alloc(frame_cache);
+    ASSERT (frame != NULL);
+
     lock_acquire(&frame_lock);
 
     void* kpage = palloc_get_page (PAL_USER | flags);
@@ -50,24 +84,31 @@ void * frame_allocate (enum palloc_flags flags, void *upage){
         /* Could not allocate frame - find frame to evict */
         struct frame *evicted_frame = find_frame_to_evict(thread_current());
 
-        /* was evicted frame dirty? */
-        bool is_dirty = pagedir_is_dirty(evicted_frame->thread->pagedir, evicted_frame->upage) ||
-                        pagedir_is_dirty(evicted_frame->thread->pagedir, evicted_frame->kpage);
-
-        pagedir_clear_page(evicted_frame->thread->pagedir, evicted_frame->upage);
-        
-        struct page *p = page_get(evicted_frame->upage);
-        /* if we had a non-dirty frame from filesys, we can just delete it - it'll be read in again when needed*/
-        if (p->pstatus == FROM_FILE && !is_dirty){
-            p->has_frame = false;
-            p->kpage = NULL;
+        /* shared frames are clean file pages: unmap them from every
+           sharer and they will be faulted in again from the file */
+        if (evicted_frame->inode != NULL){
+            frame_share_unmap_all(evicted_frame);
         }
-        else{
-            size_t swap_slot = swap_out(evicted_frame->kpage);
-            page_set_on_swap(evicted_frame->upage, swap_slot);
+        else {
+            /* was evicted frame dirty? */
+            bool is_dirty = pagedir_is_dirty(evicted_frame->thread->pagedir, evicted_frame->upage) ||
+                            pagedir_is_dirty(evicted_frame->thread->pagedir, evicted_frame->kpage);
+
+            pagedir_clear_page(evicted_frame->thread->pagedir, evicted_frame->upage);
+
+            struct page *p = page_get(evicted_frame->upage);
+            /* if we had a non-dirty frame from filesys, we can just delete it - it'll be read in again when needed*/
+            if (p->pstatus == FROM_FILE && !is_dirty){
+                p->has_frame = false;
+                p->kpage = NULL;
+                page_tlb_invalidate(p->thread, p->upage);
+            }
+            else{
+                size_t swap_slot = swap_out(evicted_frame->kpage);
+                page_set_on_swap(evicted_frame->upage, swap_slot);
+            }
         }
 
-
         frame_free(evicted_frame->kpage, true, false);
         
         /* let's try again */
@@ -75,16 +116,23 @@ void * frame_allocate (enum palloc_flags flags, void *upage){
         ASSERT(kpage != NULL);
     }
 
-    struct frame *frame = malloc(sizeof(struct frame));
-    ASSERT (frame != NULL);
-
     frame->thread = thread_current();
     frame->upage = upage;
     frame->kpage = kpage;
-    frame->pinned = true;
+    frame->pin_cnt = 1;
+    frame->inode = NULL;
+    frame->file_offset = 0;
+    frame->file_bytes = 0;
 
+    /* the frame table could not grow */
+    if (rhash_insert(&frame_table, &frame->hash_elem) != NULL){
+        lock_release(&frame_lock);
+        palloc_free_page(kpage);
+        kmem_cache_free(frame_cache, frame);
+        return NULL;
+    }
+    frame->thread->frame_meta_bytes += kmem_cache_obj_size(frame_cache);
     list_push_back (&frame_clock_list, &frame->list_elem);
-    hash_insert(&frame_table, &frame->hash_elem);
 
     lock_release(&frame_lock);
 
@@ -106,18 +154,118 @@ frame_free(void *kpage, bool free_kpage, bool with_lock){
     ASSERT (pg_round_down (kpage) == kpage);
 
     struct frame *f = frame_get(kpage);
-    hash_delete (&frame_table, &f->hash_elem);
-    list_remove (&f->list_elem);
+    frame_detach(f);
     if (free_kpage){
         palloc_free_page(kpage);
     }
-    free(f);
+    frame_destroy(f);
 
     if (with_lock){
         lock_release(&frame_lock);
     }
 }
 
+/* Takes F out of the frame table and the clock list.
+   Called with frame_lock held. */
+static void
+frame_detach(struct frame *f){
+    rhash_remove (&frame_table, &f->hash_elem);
+    /* don't leave the clock hand on a removed element */
+    if (clock_ptr == &f->list_elem){
+        clock_ptr = list_prev (clock_ptr);
+    }
+    list_remove (&f->list_elem);
+}
+
+/* Returns constructed frame F_ to the state frame_cache hands it out
+   in. Called once per object, not once per allocation. */
+static void
+frame_ctor(void *f_){
+    struct frame *f = f_;
+    list_init(&f->sharers);
+}
+
+/* Gives F back to frame_cache and uncharges its owner.
+   Called with frame_lock held. */
+static void
+frame_destroy(struct frame *f){
+    ASSERT(list_empty(&f->sharers));
+    f->thread->frame_meta_bytes -= kmem_cache_obj_size(frame_cache);
+    kmem_cache_free(frame_cache, f);
+}
+
+/* Hands shared frame F over to sharer P, moving the charge for it.
+   Called with frame_lock held. */
+static void
+frame_set_owner(struct frame *f, struct page *p){
+    size_t size = kmem_cache_obj_size(frame_cache);
+    f->thread->frame_meta_bytes -= size;
+    f->thread = p->thread;
+    f->upage = p->upage;
+    f->thread->frame_meta_bytes += size;
+}
+
+/* Frames are handed back to frame_cache in batches of this many. */
+#define FRAME_FREE_BATCH 64
+
+/* Drops every frame mapped by exiting process T in a single locked pass
+   over T's own page table, instead of one frame_free() per page or a
+   scan of every frame in the system. Private frames are only detached:
+   their pages are still mapped in T's page directory, and
+   pagedir_destroy() frees them. T's pages are unmapped from shared
+   frames, which are freed if T was their last sharer. */
+void
+frame_release_all(struct thread *t){
+    size_t size = kmem_cache_obj_size(frame_cache);
+    void *frames[FRAME_FREE_BATCH];
+    size_t frame_cnt = 0;
+    struct rhash_iterator i;
+
+    lock_acquire(&frame_lock);
+
+    rhash_first(&i, t->page_table);
+    while (rhash_next(&i)){
+        struct page *p = rhash_entry(rhash_cur(&i), struct page, hash_elem);
+        if (!p->has_frame){
+            continue;
+        }
+        struct frame *f = frame_get(p->kpage);
+        ASSERT(f != NULL);
+
+        if (p->shared){
+            list_remove(&p->share_elem);
+            pagedir_clear_page(t->pagedir, p->upage);
+            p->shared = false;
+            p->has_frame = false;
+            p->kpage = NULL;
+            if (!list_empty(&f->sharers)){
+                if (f->thread == t){
+                    frame_set_owner(f, list_entry(list_front(&f->sharers),
+                                                  struct page, share_elem));
+                }
+                continue;
+            }
+            rhash_remove(&share_table, &f->share_elem);
+            frame_detach(f);
+            palloc_free_page(f->kpage);
+        }
+        else {
+            ASSERT(f->thread == t);
+            frame_detach(f);
+        }
+
+        f->thread->frame_meta_bytes -= size;
+        frames[frame_cnt++] = f;
+        if (frame_cnt == FRAME_FREE_BATCH){
+            kmem_cache_free_multiple(frame_cache, frames, frame_cnt);
+            frame_cnt = 0;
+        }
+    }
+    kmem_cache_free_multiple(frame_cache, frames, frame_cnt);
+
+    lock_release(&frame_lock);
+}
+
 struct frame *
 find_frame_to_evict(struct thread* t){
     size_t table_size = list_size(&frame_clock_list);
@@ -139,9 +287,25 @@ find_frame_to_evict(struct thread* t){
         }
 
         struct frame *cur_frame = list_entry(clock_ptr, struct frame, list_elem);
-        if (cur_frame->pinned){
+        if (cur_frame->pin_cnt > 0){
             continue;
         }
+        else if (cur_frame->inode != NULL){
+            /* shared frame: give it a second chance if any sharer used it */
+            bool accessed = false;
+            struct list_elem *e;
+            for (e = list_begin(&cur_frame->sharers); e != list_end(&cur_frame->sharers);
+                 e = list_next(e)){
+                struct page *s = list_entry(e, struct page, share_elem);
+                if (pagedir_is_accessed(s->thread->pagedir, s->upage)){
+                    pagedir_set_accessed(s->thread->pagedir, s->upage, false);
+                    accessed = true;
+                }
+            }
+            if (accessed){
+                continue;
+            }
+        }
         else if (pagedir_is_accessed(t->pagedir, cur_frame->upage)){
             pagedir_set_accessed(t->pagedir, cur_frame->upage, false);
             continue;
@@ -156,25 +320,124 @@ find_frame_to_evict(struct thread* t){
     PANIC("Tried to evict a frame, but no frame is available");
 }
 
-static void
-frame_set_pinned(void *kpage, bool new_val){
-
+/* Pins are counted, since several processes sharing a frame may each
+   pin it for a syscall buffer or a fault in progress. */
+void
+frame_pin(void *kpage){
     lock_acquire(&frame_lock);
 
     struct frame *f = frame_get(kpage);
-    f->pinned = new_val;
+    f->pin_cnt++;
 
     lock_release(&frame_lock);
 }
 
 void
-frame_pin(void *kpage){
-    frame_set_pinned(kpage, true);
+frame_unpin(void *kpage){
+    lock_acquire(&frame_lock);
+
+    struct frame *f = frame_get(kpage);
+    ASSERT(f->pin_cnt > 0);
+    f->pin_cnt--;
+
+    lock_release(&frame_lock);
+}
+
+/* Looks up a resident frame holding the same read-only file page as P,
+   read with the same length, and adds P to its sharers. The frame is returned with a pin held for
+   P, so it cannot be evicted before the caller maps it; the caller drops
+   that pin with frame_unpin(). Returns NULL if no other process
+   has the page resident. */
+void *
+frame_share_lookup(struct page *p){
+    ASSERT(page_is_shareable(p));
+
+    struct frame key;
+    key.inode = file_get_inode(p->file);
+    key.file_offset = p->file_offset;
+    key.file_bytes = p->file_bytes;
+
+    lock_acquire(&frame_lock);
+    struct rhash_elem *h = rhash_find(&share_table, &key.share_elem);
+    void *kpage = NULL;
+    if (h != NULL){
+        struct frame *f = rhash_entry(h, struct frame, share_elem);
+        list_push_back(&f->sharers, &p->share_elem);
+        f->pin_cnt++;
+        p->shared = true;
+        kpage = f->kpage;
+    }
+    lock_release(&frame_lock);
+    return kpage;
+}
+
+/* Publishes KPAGE, freshly read from P's file, so later faults on the
+   same page by other processes can map it. Returns false if another
+   process registered the same page first, or if the shared frame table
+   is out of memory; KPAGE then stays private. */
+bool
+frame_share_register(void *kpage, struct page *p){
+    ASSERT(page_is_shareable(p));
+
+    lock_acquire(&frame_lock);
+    struct frame *f = frame_get(kpage);
+    ASSERT(f != NULL && f->inode == NULL);
+    f->inode = file_get_inode(p->file);
+    f->file_offset = p->file_offset;
+    f->file_bytes = p->file_bytes;
+    bool success = rhash_insert(&share_table, &f->share_elem) == NULL;
+    if (success){
+        list_push_back(&f->sharers, &p->share_elem);
+        p->shared = true;
+    }
+    else {
+        f->inode = NULL;
+    }
+    lock_release(&frame_lock);
+    return success;
 }
 
+/* Drops P's reference to its shared frame and unmaps it from P's page
+   directory. The last sharer frees the frame. */
 void
-frame_unpin(void *kpage){
-    frame_set_pinned(kpage, false);
+frame_share_release(struct page *p){
+    ASSERT(p->shared && p->kpage != NULL);
+
+    lock_acquire(&frame_lock);
+    struct frame *f = frame_get(p->kpage);
+    list_remove(&p->share_elem);
+    pagedir_clear_page(p->thread->pagedir, p->upage);
+    p->shared = false;
+    p->has_frame = false;
+    p->kpage = NULL;
+
+    if (list_empty(&f->sharers)){
+        rhash_remove(&share_table, &f->share_elem);
+        frame_free(f->kpage, true, false);
+    }
+    else if (f->thread == p->thread){
+        /* owner is leaving; hand the frame to the next sharer */
+        frame_set_owner(f, list_entry(list_front(&f->sharers), struct page, share_elem));
+    }
+    lock_release(&frame_lock);
+}
+
+/* Unmaps shared frame F from every process that maps it and takes it out
+   of the shared frame table. Called with frame_lock held. */
+static void
+frame_share_unmap_all(struct frame *f){
+    ASSERT(lock_held_by_current_thread(&frame_lock));
+
+    while (!list_empty(&f->sharers)){
+        struct page *s = list_entry(list_pop_front(&f->sharers), struct page, share_elem);
+        pagedir_clear_page(s->thread->pagedir, s->upage);
+        s->shared = false;
+        s->has_frame = false;
+        s->kpage = NULL;
+        page_tlb_invalidate(s->thread, s->upage);
+    }
+    rhash_remove(&share_table, &f->share_elem);
+    f->inode = NULL;
 }
 
 void
@@ -186,13 +449,31 @@ frame_lock_release(){
     lock_release(&frame_lock);
 }
 
-static unsigned frame_hash_func(const struct hash_elem *elem, void *aux UNUSED){
-  struct frame *entry = hash_entry(elem, struct frame, hash_elem);
+static unsigned frame_hash_func(const struct rhash_elem *elem, void *aux UNUSED){
+  struct frame *entry = rhash_entry(elem, struct frame, hash_elem);
   return hash_bytes( &entry->kpage, sizeof entry->kpage );
 }
 
-static bool frame_less_func(const struct hash_elem *a_, const struct hash_elem *b_, void *aux UNUSED){
-  struct frame *a = hash_entry(a_, struct frame, hash_elem);
-  struct frame *b = hash_entry(b_, struct frame, hash_elem);
+static bool frame_less_func(const struct rhash_elem *a_, const struct rhash_elem *b_, void *aux UNUSED){
+  struct frame *a = rhash_entry(a_, struct frame, hash_elem);
+  struct frame *b = rhash_entry(b_, struct frame, hash_elem);
   return a->kpage < b->kpage;
+}
+
+static unsigned share_hash_func(const struct rhash_elem *elem, void *aux UNUSED){
+  struct frame *entry = rhash_entry(elem, struct frame, share_elem);
+  return hash_bytes(&entry->inode, sizeof entry->inode) ^ hash_int(entry->file_offset)
+         ^ hash_int(entry->file_bytes);
+}
+
+static bool share_less_func(const struct rhash_elem *a_, const struct rhash_elem *b_, void *aux UNUSED){
+  struct frame *a = rhash_entry(a_, struct frame, share_elem);
+  struct frame *b = rhash_entry(b_, struct frame, share_elem);
+  if (a->inode != b->inode){
+    return a->inode < b->inode;
+  }
+  if (a->file_offset != b->file_offset){
+    return a->file_offset < b->file_offset;
+  }
+  return a->file_bytes < b->file_bytes;
 }
\ No newline at end of file
@@ -3,7 +3,8 @@
 
 #include "threads/thread.h"
 #include "threads/palloc.h"
-#include <hash.h>
+#include "filesys/off_t.h"
+#include <rhash.h>
 #include <list.h>
 
 struct frame 
@@ -12,17 +13,36 @@ struct frame
     void *kpage;                /* Kernel physical address */
     void *upage;                /* User Virtual Memory Address */
     // struct lock lock;           /* Lock for each frame table entry */
-    bool pinned;            /* Pinned frame cannot be evicted */
+    unsigned pin_cnt;       /* Frame cannot be evicted while nonzero */
     struct list_elem list_elem;    /* Linked List elem */
-    struct hash_elem hash_elem;     /* Hash Table elem  */
+    struct rhash_elem hash_elem;    /* Hash Table elem  */
+
+    /* Read-only file pages shared between processes running the
+       same executable.  INODE is NULL for private frames.  Pages at
+       the same offset are only interchangeable if they read the
+       same number of bytes, the rest being zeroed, so FILE_BYTES is
+       part of the key. */
+    struct inode *inode;            /* Backing inode of a shared frame */
+    off_t file_offset;              /* Offset of the page in INODE */
+    uint32_t file_bytes;            /* Bytes read from INODE */
+    struct list sharers;            /* `struct page's mapping this frame */
+    struct rhash_elem share_elem;   /* Shared frame table elem */
 };
 void frame_table_init ();
 void * frame_allocate (enum palloc_flags flags, void *upage);
 void frame_free(void *kpage, bool free_kpage, bool with_lock);
+void frame_release_all(struct thread *t);
 
 void frame_pin(void *kpage);
 void frame_unpin(void *kpage);
 
+void *frame_zero_page(void);
+
+struct page;
+void *frame_share_lookup(struct page *p);
+bool frame_share_register(void *kpage, struct page *p);
+void frame_share_release(struct page *p);
+
 void frame_lock_acquire();
 void frame_lock_release();
 
@@ -13,27 +13,92 @@
 #include "userprog/exception.h"
 
 
+/* page_get() cache statistics. */
+static long long page_tlb_hits;
+static long long page_tlb_misses;
+
+/* struct page objects. */
+static struct kmem_cache *page_cache;
+
+/* Most VM metadata held by any process that has exited. */
+static size_t page_meta_peak;
+static char page_meta_peak_name[16];
+
 static bool page_install(void *upage, void *kpage, bool writable);
+static void *page_map_shared(struct page *p);
+static void page_zero_unmap(struct page *p);
 
 
-/* Get page from the page table by it's virtual address */
+void
+page_init(void){
+    page_cache = kmem_cache_create("page", sizeof(struct page), NULL);
+    if (page_cache == NULL){
+        PANIC("Could not create page cache");
+    }
+}
+
+/* Get page from the page table by it's virtual address.
+   The last few translations are cached in a small direct-mapped
+   table in the thread, which saves a hash lookup on repeated faults
+   and pinned syscall buffers touching the same pages. */
 struct page*
 page_get (const void* vaddr){
-    if (thread_current()->page_table == NULL){
+    struct thread *t = thread_current();
+    if (t->page_table == NULL){
         return NULL;
     }
+    void *upage = pg_round_down (vaddr);
+    struct page **slot = &t->page_tlb[pg_no (upage) & (PAGE_TLB_SIZE - 1)];
+    if (*slot != NULL && (*slot)->upage == upage){
+        page_tlb_hits++;
+        return *slot;
+    }
+    page_tlb_misses++;
+
     struct page p;
-    struct hash_elem* e;
-    p.upage = (void *) pg_round_down (vaddr);
-    e = hash_find (thread_current()->page_table, &p.hash_elem);
+    struct rhash_elem* e;
+    p.upage = upage;
+    e = rhash_find (t->page_table, &p.hash_elem);
     if (e != NULL) {
-        return hash_entry (e, struct page, hash_elem);
+        *slot = rhash_entry (e, struct page, hash_elem);
+        return *slot;
     }
     else {
         return NULL;
     }
 }
 
+/* Drops UPAGE from T's page_get() cache. */
+void
+page_tlb_invalidate(struct thread *t, const void *upage){
+    struct page **slot = &t->page_tlb[pg_no (upage) & (PAGE_TLB_SIZE - 1)];
+    if (*slot != NULL && (*slot)->upage == upage){
+        *slot = NULL;
+    }
+}
+
+/* Bytes of VM metadata held by T: its struct pages, the frames it
+   owns and its page table's slot arrays. */
+size_t
+page_meta_bytes(const struct thread *t){
+    size_t bytes = t->page_meta_bytes + t->frame_meta_bytes;
+    if (t->page_table != NULL){
+        bytes += sizeof *t->page_table + rhash_table_bytes(t->page_table);
+    }
+    return bytes;
+}
+
+/* Prints page_get() cache and VM metadata statistics. */
+void
+page_print_stats(void){
+    printf("Page table cache: %lld hits, %lld misses\n",
+           page_tlb_hits, page_tlb_misses);
+    if (page_meta_peak > 0){
+        printf("VM metadata: at most %zu bytes in one process (%s)\n",
+               page_meta_peak, page_meta_peak_name);
+    }
+}
+
 bool
 page_set_on_swap(const void* upage, size_t swap_slot){
     struct page *p = page_get(upage);
@@ -45,6 +110,7 @@ page_set_on_swap(const void* upage, size_t swap_slot){
     p->has_frame = false;
     p->swap_slot = swap_slot;
     p->kpage = NULL;
+    page_tlb_invalidate(p->thread, p->upage);
     return true;
 }
 
@@ -54,10 +120,11 @@ page_create (void *upage, enum pstatus starting_status, void *aux){
     ASSERT(upage != NULL);
 
 
-    struct page *new_page = (struct page*) malloc(sizeof(struct page));
+    struct page *new_page = kmem_cache_alloc(page_cache);
     if (new_page == NULL){
         PANIC("Could not allocate new page in page_create");
     }
+    thread_current()->page_meta_bytes += kmem_cache_obj_size(page_cache);
 
     /* default field values */
     new_page->upage = upage;
@@ -71,6 +138,8 @@ page_create (void *upage, enum pstatus starting_status, void *aux){
     new_page->swap_slot = NULL;
     new_page->pstatus = starting_status;
     new_page->has_frame = false;
+    new_page->shared = false;
+    new_page->zero_mapped = false;
 
     struct page *aux_data = (struct page * ) aux;
 
@@ -99,8 +168,15 @@ page_create (void *upage, enum pstatus starting_status, void *aux){
             break;
     }
 
-    /* hash_insert returns notNULL if elem is already present */
-    if (hash_insert(thread_current()->page_table, &new_page->hash_elem) != NULL){
+    /* rhash_insert returns notNULL if elem is already present,
+       or the elem itself if the table could not grow */
+    struct rhash_elem *dup = rhash_insert(thread_current()->page_table, &new_page->hash_elem);
+    if (dup == &new_page->hash_elem){
+        thread_current()->page_meta_bytes -= kmem_cache_obj_size(page_cache);
+        kmem_cache_free(page_cache, new_page);
+        return false;
+    }
+    if (dup != NULL){
         PANIC("Tried to insert a duplicate page table entry");
     }
 
@@ -112,6 +188,13 @@ page_create (void *upage, enum pstatus starting_status, void *aux){
 }
 
 
+/* Read-only pages backed by an executable can be mapped by every
+   process running it. */
+bool
+page_is_shareable(const struct page *p){
+    return p->pstatus == FROM_FILE && !p->writable && p->file != NULL;
+}
+
 bool
 page_read_from_file(struct page *p, void *kpage){
     ASSERT(p->file_bytes + p->zero_bytes == PGSIZE);
@@ -125,7 +208,7 @@ page_read_from_file(struct page *p, void *kpage){
 }
 
 bool
-handle_page_fault (void* fault_addr){
+handle_page_fault (void* fault_addr, bool write){
 
     fault_addr = pg_round_down(fault_addr);
     //printf("DEBUG: handle_page_fault for %p \n", fault_addr);
@@ -138,6 +221,24 @@ handle_page_fault (void* fault_addr){
         return true;
     }
 
+    /* reading an untouched zero page: no frame until the first store */
+    if (!write && p->pstatus == ZERO_PAGE){
+        if (p->zero_mapped){
+            return true;
+        }
+        if (!page_install(p->upage, frame_zero_page(), false)){
+            return false;
+        }
+        p->zero_mapped = true;
+        return true;
+    }
+
+    void *shared_kpage = page_map_shared(p);
+    if (shared_kpage != NULL){
+        frame_unpin(shared_kpage);
+        return true;
+    }
+
     void* new_kpage = frame_allocate(PAL_USER, p->upage);
     /* Could not allocate a frame for this page */
     if (new_kpage == NULL){
@@ -183,11 +284,56 @@ handle_page_fault (void* fault_addr){
         p->pstatus = FROM_FRAME;
         
     }
+    if (page_is_shareable(p)){
+        frame_share_register(new_kpage, p);
+    }
     frame_unpin(new_kpage);
 
     return true;
 }
 
+/* Copy-on-write for a ZERO_PAGE that is mapped to the shared zero
+   frame: gives the page a private zeroed frame and maps it writable.
+   Returns false if the fault at FAULT_ADDR is a genuine rights
+   violation. */
+bool
+handle_page_write_fault (void* fault_addr){
+    struct page *p = page_get(pg_round_down(fault_addr));
+    if (p == NULL || !p->zero_mapped || !p->writable){
+        return false;
+    }
+
+    void* new_kpage = frame_allocate(PAL_USER | PAL_ZERO, p->upage);
+    if (new_kpage == NULL){
+        return false;
+    }
+    page_zero_unmap(p);
+    if(!page_install(p->upage, new_kpage, true)){
+        frame_free(new_kpage, true, true);
+        return false;
+    }
+
+    p->has_frame = true;
+    p->kpage = new_kpage;
+    p->pstatus = FROM_FRAME;
+    frame_unpin(new_kpage);
+
+    return true;
+}
+
+/* Drops the pins preload_multiple_pages_and_pin() took on the pages
+   from START_ADDR up to (not including) page END, after it failed. */
+static void
+preload_undo(const void *start_addr, void *end){
+    void *first = pg_round_down(start_addr);
+    if (end > first){
+        unpin_multiple_pages(first, end - first);
+    }
+}
+
+/* Faults in and pins every page of the SIZE bytes at START_ADDR. On
+   failure nothing is left pinned; on success the caller unpins the
+   range with unpin_multiple_pages(). */
 bool
 preload_multiple_pages_and_pin(const void *start_addr, size_t size){
     /* iterate through all pages */
@@ -208,9 +354,13 @@ preload_multiple_pages_and_pin(const void *start_addr, size_t size){
 
             if (!(is_user_vaddr(cur_page) && valid_stack_addr)){
                 /* preloading failed due to bad buffer address */
+                preload_undo(start_addr, cur_page);
+                return false;
+            }
+            if (!page_create(pg_round_down(cur_page), ZERO_PAGE, NULL)){
+                preload_undo(start_addr, cur_page);
                 return false;
             }
-            page_create(pg_round_down(cur_page), ZERO_PAGE, NULL);
         }
         p = page_get(cur_page);
         /* now page MUST exist */
@@ -219,8 +369,17 @@ preload_multiple_pages_and_pin(const void *start_addr, size_t size){
             frame_pin(p->kpage);
             continue;
         }
+        /* shared frames come back pinned */
+        if (page_map_shared(p) != NULL){
+            continue;
+        }
+        /* the kernel may store into the buffer, so give it a real frame */
+        page_zero_unmap(p);
         void* new_kpage = frame_allocate(PAL_USER, p->upage);
-        ASSERT(new_kpage != NULL);
+        if (new_kpage == NULL){
+            preload_undo(start_addr, cur_page);
+            return false;
+        }
         switch(p->pstatus){
             case ZERO_PAGE:
                 memset(new_kpage, 0, PGSIZE);
@@ -234,6 +393,7 @@ preload_multiple_pages_and_pin(const void *start_addr, size_t size){
                 /* Handle not being able to read from file*/
                 if (!page_read_from_file(p, new_kpage)){
                     frame_free(new_kpage, true, true);
+                    preload_undo(start_addr, cur_page);
                     return false;
                 }
                 break;
@@ -242,14 +402,18 @@ preload_multiple_pages_and_pin(const void *start_addr, size_t size){
         }
         if(!page_install(p->upage, new_kpage, p->writable)){
             frame_free(new_kpage, true, true);
+            preload_undo(start_addr, cur_page);
             return false;
         }
-        frame_pin(new_kpage);
+        /* keep the pin frame_allocate() returned the frame with */
         p->has_frame = true;
         p->kpage = new_kpage;
         if(p->pstatus != FROM_FILE){
             p->pstatus = FROM_FRAME;
         }
+        if (page_is_shareable(p)){
+            frame_share_register(new_kpage, p);
+        }
 
         continue;
     }
@@ -267,41 +431,108 @@ unpin_multiple_pages(const void *start_addr, size_t size){
 }
 
 unsigned
-page_hash_func(const struct hash_elem *e, void *aux UNUSED){
-    const struct page *p = hash_entry(e, struct page, hash_elem);
+page_hash_func(const struct rhash_elem *e, void *aux UNUSED){
+    const struct page *p = rhash_entry(e, struct page, hash_elem);
     return ((uintptr_t) p->upage) >> PGBITS;
 }
 
 /* to compare two hash elements. Return true if page A precedes page B.*/
 bool
-page_less_func(const struct hash_elem *a_, const struct hash_elem *b_,
+page_less_func(const struct rhash_elem *a_, const struct rhash_elem *b_,
                void *aux UNUSED){
-    const struct page *a = hash_entry (a_, struct page, hash_elem);
-    const struct page *b = hash_entry (b_, struct page, hash_elem);
+    const struct page *a = rhash_entry (a_, struct page, hash_elem);
+    const struct page *b = rhash_entry (b_, struct page, hash_elem);
     return a->upage < b->upage;
 }
 
-void
-page_destroy_func(struct hash_elem *e, void *aux UNUSED){
-  const struct page *p = hash_entry(e, struct page, hash_elem);
-  if (p->kpage != NULL) {
-    ASSERT (p->has_frame == true);
-    frame_free(p->kpage, false, true);
-  }
-  else if(p->pstatus == ON_SWAP) {
-    swap_free (p->swap_slot);
-  }
-  free (p);
-}
+/* Swap slots and struct pages are handed back in batches of this many. */
+#define SWAP_FREE_BATCH 64
+#define PAGE_FREE_BATCH 64
 
 void
 clear_page_table(){
     //printf("DEBUG: clear_page_table for thread: %p\n", thread_current());
-    struct hash *h = thread_current()->page_table;
-    if (h != NULL){
-        hash_destroy (h, page_destroy_func);
+    struct thread *t = thread_current();
+    struct rhash *h = t->page_table;
+    if (h == NULL){
+        return;
+    }
+
+    size_t meta_bytes = page_meta_bytes(t);
+    if (meta_bytes > page_meta_peak){
+        page_meta_peak = meta_bytes;
+        strlcpy(page_meta_peak_name, t->name, sizeof page_meta_peak_name);
+    }
+
+    /* detach all of our frames in one pass over the frame table */
+    frame_release_all(t);
+
+    /* the iterator only reads the slot array, so pages can be freed
+       as we go */
+    size_t swap_slots[SWAP_FREE_BATCH];
+    size_t slot_cnt = 0;
+    void *pages[PAGE_FREE_BATCH];
+    size_t page_cnt = 0;
+    struct rhash_iterator i;
+    rhash_first(&i, h);
+    while (rhash_next(&i)){
+        struct page *p = rhash_entry(rhash_cur(&i), struct page, hash_elem);
+        if (p->zero_mapped){
+            /* keep pagedir_destroy from freeing the zero frame */
+            page_zero_unmap(p);
+        }
+        else if (p->pstatus == ON_SWAP && !p->has_frame){
+            swap_slots[slot_cnt++] = p->swap_slot;
+            if (slot_cnt == SWAP_FREE_BATCH){
+                swap_free_multiple(swap_slots, slot_cnt);
+                slot_cnt = 0;
+            }
+        }
+        pages[page_cnt++] = p;
+        if (page_cnt == PAGE_FREE_BATCH){
+            kmem_cache_free_multiple(page_cache, pages, page_cnt);
+            page_cnt = 0;
+        }
+    }
+    swap_free_multiple(swap_slots, slot_cnt);
+    kmem_cache_free_multiple(page_cache, pages, page_cnt);
+
+    memset (t->page_tlb, 0, sizeof t->page_tlb);
+    rhash_destroy (h, NULL);
+    t->page_meta_bytes = 0;
+    free (h);
+    t->page_table = NULL;
+}
+
+/* Maps P onto a frame that already holds the same read-only file page
+   in another process. Returns the frame, pinned, or NULL if the page
+   has to be read in privately. */
+static void *
+page_map_shared(struct page *p){
+    if (!page_is_shareable(p)){
+        return NULL;
+    }
+    void *kpage = frame_share_lookup(p);
+    if (kpage == NULL){
+        return NULL;
+    }
+    p->kpage = kpage;
+    p->has_frame = true;
+    if (!page_install(p->upage, kpage, false)){
+        frame_unpin(kpage);
+        frame_share_release(p);
+        return NULL;
+    }
+    return kpage;
+}
+
+/* Removes P's read-only mapping of the zero frame, if any. */
+static void
+page_zero_unmap(struct page *p){
+    if (p->zero_mapped){
+        pagedir_clear_page(p->thread->pagedir, p->upage);
+        p->zero_mapped = false;
     }
-    h = NULL;
 }
 
 /* copy pasted install_page from process.c */
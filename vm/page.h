@@ -2,7 +2,8 @@
 #ifndef VM_PAGE_H
 #define VM_PAGE_H
 
-#include <hash.h>
+#include <rhash.h>
+#include <list.h>
 #include "filesys/off_t.h"
 
 /* max size of process stack*/
@@ -22,7 +23,7 @@ struct page
     void *kpage;            /* physical frame address. NULL if not HAS_FRAME */
     bool writable;          /* writable or read-only */
     struct thread *thread;  /* thread that owns the page */
-    struct hash_elem hash_elem; /* thread's `hash_table' hash element. */
+    struct rhash_elem hash_elem; /* thread's `page_table' hash element. */
 
     struct file *file;          /* File */
     off_t file_offset;          /* File Offset */
@@ -33,22 +34,32 @@ struct page
     size_t swap_slot;           /* swap slot index in the swap_bitmap */
 
     bool has_frame;
+    bool shared;                /* Maps a frame shared with other processes */
+    bool zero_mapped;           /* ZERO_PAGE mapped read-only to the zero frame */
+    struct list_elem share_elem; /* frame's `sharers' list element */
 };
 
 
-bool handle_page_fault(void* fault_addr); /* called in exception.c*/
+void page_init(void);
+
+bool handle_page_fault(void* fault_addr, bool write); /* called in exception.c*/
+bool handle_page_write_fault(void* fault_addr); /* called in exception.c*/
 
 bool page_create (void *upage, enum pstatus starting_status, void *aux);
 
 struct page* page_get (const void* vaddr);
 
 bool page_set_on_swap(const void* upage, size_t swap_slot);
+bool page_is_shareable(const struct page *p);
 
 bool preload_multiple_pages_and_pin (const void *start_addr, size_t size);
 void unpin_multiple_pages(const void *start_addr, size_t size);
 
 void clear_page_table();
+void page_tlb_invalidate(struct thread *t, const void *upage);
+size_t page_meta_bytes(const struct thread *t);
+void page_print_stats(void);
 
-hash_hash_func page_hash_func;
-hash_less_func page_less_func;
+rhash_hash_func page_hash_func;
+rhash_less_func page_less_func;
 #endif /* vm/page.h */
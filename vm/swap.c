@@ -1,4 +1,6 @@
 #include <bitmap.h>
+#include <stdlib.h>
+#include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "devices/block.h"
 #include "vm/swap.h"
@@ -8,12 +10,14 @@ static const size_t SECTORS_PER_PAGE = PGSIZE / BLOCK_SECTOR_SIZE;
 static struct block *swap_block;
 static struct bitmap *swap_bitmap;
 static size_t swap_size;
+static struct lock swap_lock; /* protects swap_bitmap */
 
 void
 swap_init(){
     swap_block = block_get_role(BLOCK_SWAP);
     swap_size = block_size(swap_block) / SECTORS_PER_PAGE;
     ASSERT (swap_size > 0);
+    lock_init(&swap_lock);
     swap_bitmap = bitmap_create(swap_size);
     ASSERT(swap_bitmap != NULL);
     /* initially all of bitmap is free */
@@ -27,16 +31,14 @@ return the index of the written slot
 size_t
 swap_out(void* kpage){
     //printf("DEBUG: swap_out: %p\n", kpage);
-    /* find available region */
-    size_t swap_slot = bitmap_scan(swap_bitmap, 0, 1, true);
+    /* find available region and set bitmap at swap_slot as used */
+    lock_acquire(&swap_lock);
+    size_t swap_slot = bitmap_scan_and_flip_next(swap_bitmap, 1, true);
+    lock_release(&swap_lock);
     ASSERT(swap_slot != BITMAP_ERROR);
 
-    for (int i = 0; i < SECTORS_PER_PAGE; ++i){
-        block_write(swap_block, swap_slot * SECTORS_PER_PAGE + i, kpage + (BLOCK_SECTOR_SIZE * i));
-    }
-    /* set bitmap at swap_slot as used */
-    bitmap_set(swap_bitmap, swap_slot, false);
-
+    block_transfer(swap_block, BLOCK_IO_PAGING, true,
+                   swap_slot * SECTORS_PER_PAGE, SECTORS_PER_PAGE, kpage);
     return swap_slot;
 }
 
@@ -46,19 +48,52 @@ read contents from block at swap_slot into the frame
 void
 swap_in(size_t swap_slot, void *kpage){
     ASSERT(swap_slot < swap_size);
-    /* make sure bitmap at slot index is defined */
-    ASSERT(bitmap_test(swap_bitmap, swap_slot) == false);
 
-    for (int i = 0; i < SECTORS_PER_PAGE; ++i){
-        block_read(swap_block, swap_slot * SECTORS_PER_PAGE + i, kpage + (BLOCK_SECTOR_SIZE * i));
-    }
+    block_transfer(swap_block, BLOCK_IO_PAGING, false,
+                   swap_slot * SECTORS_PER_PAGE, SECTORS_PER_PAGE, kpage);
     /* set bitmap at swap_slot as free */
-    bitmap_set(swap_bitmap, swap_slot, true);
+    swap_free(swap_slot);
 }
 
 void
 swap_free (size_t swap_slot){
   ASSERT (swap_slot < swap_size);
+  lock_acquire(&swap_lock);
   ASSERT (bitmap_test(swap_bitmap, swap_slot) == false);
   bitmap_set(swap_bitmap, swap_slot, true);
+  lock_release(&swap_lock);
+}
+
+static int
+compare_slots (const void *a_, const void *b_){
+  const size_t *a = a_;
+  const size_t *b = b_;
+  return *a < *b ? -1 : *a > *b;
+}
+
+/*
+free CNT swap slots at once, e.g. everything an exiting process
+had swapped out. Sorts SWAP_SLOTS and releases each run of adjacent
+slots with a single bitmap update, under one acquisition of the lock.
+*/
+void
+swap_free_multiple (size_t *swap_slots, size_t cnt){
+  if (cnt == 0){
+    return;
+  }
+  qsort(swap_slots, cnt, sizeof *swap_slots, compare_slots);
+
+  lock_acquire(&swap_lock);
+  size_t start = 0;
+  while (start < cnt){
+    size_t run = 1;
+    while (start + run < cnt && swap_slots[start + run] == swap_slots[start] + run){
+      run++;
+    }
+    ASSERT (swap_slots[start] + run <= swap_size);
+    ASSERT (bitmap_none(swap_bitmap, swap_slots[start], run));
+    bitmap_set_multiple(swap_bitmap, swap_slots[start], run, true);
+    start += run;
+  }
+  lock_release(&swap_lock);
 }
\ No newline at end of file
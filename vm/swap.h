@@ -5,5 +5,6 @@ void swap_init();
 size_t swap_out(void *kpage);
 void swap_in(size_t swap_slot, void *kpage);
 void swap_free (size_t swap_slot);
+void swap_free_multiple (size_t *swap_slots, size_t cnt);
 
 #endif /* vm/swap.h */
\ No newline at end of file